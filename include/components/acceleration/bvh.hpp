@@ -0,0 +1,63 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - bvh.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_BVH
+#define RAY_TRACER_BVH
+
+#include <cstdint>
+#include <vector>
+
+#include "components/math/aabb.hpp"
+
+// One node of the flattened tree, two of them share a 64 byte cache line.
+// Nodes are stored depth-first, so the first child of an interior node is
+// always the next node in the array and only the second child needs an offset.
+struct alignas(32) bvh_node
+{
+    packed_aabb bounds; // packed, so the node stays 32 bytes under RAY_TRACER_SIMD_MATH too
+    uint32_t offset{0};     // leaf: first index into bvh::prim_indices, interior: index of the second child
+    uint16_t prim_count{0}; // 0 for interior nodes
+    uint8_t axis{0};        // interior: split axis, picks the near child from the ray direction
+    uint8_t pad{0};
+
+    [[nodiscard]] bool is_leaf() const { return prim_count > 0; }
+};
+static_assert(sizeof(bvh_node) == 32);
+
+struct bvh_build_stats
+{
+    double build_ms{0};
+    size_t node_count{0};
+    size_t leaf_count{0};
+    int max_depth{0};
+    float sah_cost{0}; // expected cost of a random ray, relative to one primitive test
+};
+
+struct bvh
+{
+    // traversal never goes deeper than this, it sizes the fixed traversal stack
+    static constexpr int MAX_DEPTH = 64;
+
+    std::vector<bvh_node> nodes;        // depth-first, root at 0
+    std::vector<uint32_t> prim_indices; // leaf order -> primitive index
+    bvh_build_stats stats;
+
+    [[nodiscard]] bool empty() const { return nodes.empty(); }
+
+    // Levels below a node of count primitives when every split from there takes the median, until
+    // leaves hold at most leaf_size. Builders split at the median once depth + this reaches
+    // MAX_DEPTH - 1, so the depth limit never forces a leaf past the 16-bit prim_count.
+    [[nodiscard]] static int median_depth(uint32_t count, const uint32_t leaf_size)
+    {
+        int levels = 0;
+        for (; count > leaf_size; count = (count + 1) / 2) levels++;
+        return levels;
+    }
+};
+
+#endif // RAY_TRACER_BVH
@@ -0,0 +1,97 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - light_bvh.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_LIGHT_BVH
+#define RAY_TRACER_LIGHT_BVH
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "components/math/aabb.hpp"
+#include "components/math/vector3.hpp"
+
+// The directions a group of emitters faces: every normal lies within theta_o of axis.
+// Emitters here light both sides, so a cone also stands for its mirror image and the
+// normals can be flipped to whichever side keeps it narrow. cos_theta_o = -1 is every direction.
+struct normal_cone
+{
+    vector3 axis{0, 0, 1};
+    float cos_theta_o{-1.0f};
+
+    [[nodiscard]] static normal_cone every_direction() { return {}; }
+
+    // the narrowest cone this method finds around both, after flipping b towards a
+    [[nodiscard]] static normal_cone merge(const normal_cone& a, normal_cone b)
+    {
+        if (a.cos_theta_o <= -1.0f || b.cos_theta_o <= -1.0f) return every_direction();
+        if (vector3::dot(a.axis, b.axis) < 0.0f) b.axis = -b.axis;
+
+        const float theta_a = std::acos(std::clamp(a.cos_theta_o, -1.0f, 1.0f));
+        const float theta_b = std::acos(std::clamp(b.cos_theta_o, -1.0f, 1.0f));
+        const float theta_d = std::acos(std::clamp(vector3::dot(a.axis, b.axis), -1.0f, 1.0f));
+        if (std::min(theta_d + theta_b, pi) <= theta_a) return a;
+        if (std::min(theta_d + theta_a, pi) <= theta_b) return b;
+
+        // the cone from a's far edge to b's far edge, its axis turned from a towards b
+        const float theta_o = (theta_a + theta_d + theta_b) * 0.5f;
+        if (theta_o >= pi) return every_direction();
+        const vector3 turn_axis = vector3::cross(a.axis, b.axis);
+        if (turn_axis.length_2() == 0.0f) return every_direction();
+        const float theta_r = theta_o - theta_a;
+        const vector3 side = vector3::cross(turn_axis.normalized(), a.axis);
+        return {(a.axis * std::cos(theta_r) + side * std::sin(theta_r)).normalized(), std::cos(theta_o)};
+    }
+
+private:
+    static constexpr float pi = static_cast<float>(M_PI);
+};
+
+// What light selection knows about a group of emitters: where they are, how much they emit
+// in total (luminance times area) and where they face.
+struct light_bounds
+{
+    aabb bounds;
+    float power{0.0f};
+    normal_cone cone;
+
+    [[nodiscard]] static light_bounds merge(const light_bounds& a, const light_bounds& b)
+    {
+        if (a.power <= 0.0f) return b;
+        if (b.power <= 0.0f) return a;
+        return {aabb::merge(a.bounds, b.bounds), a.power + b.power, normal_cone::merge(a.cone, b.cone)};
+    }
+};
+
+// Stored depth-first like bvh_node: an interior node's first child is the next node.
+struct light_bvh_node
+{
+    light_bounds b;
+    uint32_t offset{0}; // leaf: emitter index, interior: index of the second child
+    bool leaf{false};
+};
+
+// Hierarchy over a scene's emitters, each leaf holding one. trails records how to reach
+// an emitter's leaf from the root: bit d is 1 where the path takes the second child at depth d.
+struct light_bvh
+{
+    static constexpr int MAX_DEPTH = 64; // the bits of a trail
+
+    std::vector<light_bvh_node> nodes;
+    std::vector<uint64_t> trails; // per emitter
+
+    [[nodiscard]] bool empty() const { return nodes.empty(); }
+
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        return nodes.size() * sizeof(light_bvh_node) + trails.size() * sizeof(uint64_t);
+    }
+};
+
+#endif // RAY_TRACER_LIGHT_BVH
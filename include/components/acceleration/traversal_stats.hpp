@@ -0,0 +1,28 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - traversal_stats.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_TRAVERSAL_STATS
+#define RAY_TRACER_TRAVERSAL_STATS
+
+#include <cstdint>
+
+// Counters filled by the traversal functions when handed a non-null pointer.
+struct traversal_stats
+{
+    uint64_t rays{0};
+    uint64_t nodes_visited{0};
+    uint64_t prims_tested{0};
+
+    traversal_stats& operator+=(const traversal_stats& o)
+    {
+        rays += o.rays; nodes_visited += o.nodes_visited; prims_tested += o.prims_tested;
+        return *this;
+    }
+};
+
+#endif // RAY_TRACER_TRAVERSAL_STATS
@@ -0,0 +1,44 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - wide_bvh.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_WIDE_BVH
+#define RAY_TRACER_WIDE_BVH
+
+#include <cstdint>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+
+// Node with up to N children whose boxes are stored as SoA float lanes,
+// so one ray can be slab-tested against every child with a single SIMD sequence.
+template <int N>
+struct alignas(64) wide_bvh_node
+{
+    float min_x[N], min_y[N], min_z[N];
+    float max_x[N], max_y[N], max_z[N];
+    uint32_t child[N];      // interior child: node index, leaf child: first index into prim_indices
+    uint16_t prim_count[N]; // 0 for interior children
+    uint8_t child_count{0}; // lanes past this one are unused
+};
+
+template <int N>
+struct wide_bvh
+{
+    static_assert(N == 4 || N == 8, "wide BVH is built for SSE (4) and AVX (8) lanes");
+
+    std::vector<wide_bvh_node<N>> nodes; // root at 0
+    std::vector<uint32_t> prim_indices;  // leaf order -> primitive index, same as the binary tree
+    size_t leaf_count{0};
+
+    [[nodiscard]] bool empty() const { return nodes.empty(); }
+};
+
+using bvh4 = wide_bvh<4>;
+using bvh8 = wide_bvh<8>;
+
+#endif // RAY_TRACER_WIDE_BVH
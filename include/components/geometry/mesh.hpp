@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - mesh.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_MESH
+#define RAY_TRACER_MESH
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "components/math/aabb.hpp"
+#include "components/math/vector2.hpp"
+#include "components/math/vector3.hpp"
+#include "triangle.hpp"
+
+// Indexed triangle mesh: every vertex is stored once and triangles refer to
+// it by 32-bit index. normals and uvs are optional, and when present hold
+// one entry per position.
+struct mesh
+{
+    std::vector<vector3> positions;
+    std::vector<uint32_t> indices; // 3 per triangle, counter-clockwise seen from the front
+    std::vector<vector3> normals;
+    std::vector<vector2> uvs;
+
+
+    [[nodiscard]] size_t triangle_count() const { return indices.size() / 3; }
+    [[nodiscard]] bool has_normals() const { return !normals.empty(); }
+    [[nodiscard]] bool has_uvs() const { return !uvs.empty(); }
+
+    [[nodiscard]] triangle triangle_at(const size_t i) const
+    {
+        return {positions[indices[3*i]], positions[indices[3*i + 1]], positions[indices[3*i + 2]]};
+    }
+
+    [[nodiscard]] aabb bounds() const
+    {
+        aabb b;
+        for (const auto& p : positions) b.expand(p);
+        return b;
+    }
+
+    // sphere tessellated along rings x segments, with normals and uvs; the poles repeat per segment
+    static mesh uv_sphere(const vector3& center, const float radius, const int rings, const int segments)
+    {
+        mesh m;
+        for (int ring = 0; ring <= rings; ring++)
+        {
+            const float theta = static_cast<float>(M_PI) * static_cast<float>(ring) / static_cast<float>(rings);
+            for (int seg = 0; seg <= segments; seg++)
+            {
+                const float phi = 2.0f * static_cast<float>(M_PI) * static_cast<float>(seg) / static_cast<float>(segments);
+                const vector3 n(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                m.positions.push_back(center + n * radius);
+                m.normals.push_back(n);
+                m.uvs.emplace_back(static_cast<float>(seg) / static_cast<float>(segments),
+                                   static_cast<float>(ring) / static_cast<float>(rings));
+            }
+        }
+
+        const auto vertex = [segments](const int ring, const int seg) { return static_cast<uint32_t>(ring * (segments + 1) + seg); };
+        for (int ring = 0; ring < rings; ring++)
+        {
+            for (int seg = 0; seg < segments; seg++)
+            {
+                const uint32_t a = vertex(ring, seg), b = vertex(ring, seg + 1);
+                const uint32_t c = vertex(ring + 1, seg), d = vertex(ring + 1, seg + 1);
+                if (ring != 0) m.indices.insert(m.indices.end(), {a, b, c});
+                if (ring != rings - 1) m.indices.insert(m.indices.end(), {b, d, c});
+            }
+        }
+        return m;
+    }
+
+    // bytes held, for comparing against separate triangles
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        return positions.size() * sizeof(vector3) + indices.size() * sizeof(uint32_t)
+             + normals.size() * sizeof(vector3) + uvs.size() * sizeof(vector2);
+    }
+};
+
+#endif // RAY_TRACER_MESH
@@ -7,6 +7,8 @@
 
 #ifndef RAY_TRACER_SPHERE
 #define RAY_TRACER_SPHERE
+#include "components/math/aabb.hpp"
+#include "components/math/transform.hpp"
 #include "components/math/vector3.hpp"
 
 struct sphere
@@ -15,6 +17,20 @@ struct sphere
     float radius{};
 
     sphere(const vector3 center, const float radius) : center(center), radius(radius) {}
+
+    [[nodiscard]] vector3 centroid() const { return center; }
+
+    [[nodiscard]] aabb bounds() const
+    {
+        const vector3 r(radius, radius, radius);
+        return {center - r, center + r};
+    }
+
+    // non-uniform scales can't keep it a sphere, the radius takes the largest factor
+    [[nodiscard]] sphere transformed(const transform& t) const
+    {
+        return {t.point(center), radius * t.max_scale()};
+    }
 };
 
 #endif //RAY_TRACER_SPHERE
@@ -9,6 +9,8 @@
 #ifndef RAY_TRACER_TRIANGLE
 #define RAY_TRACER_TRIANGLE
 
+#include "components/math/aabb.hpp"
+#include "components/math/transform.hpp"
 #include "components/math/vector3.hpp"
 
 struct triangle
@@ -33,6 +35,16 @@ struct triangle
         return 0.5f * vector3::cross(v1-v0, v2-v0).length();
     }
 
+    [[nodiscard]] aabb bounds() const
+    {
+        return {vector3::min(v0, vector3::min(v1, v2)), vector3::max(v0, vector3::max(v1, v2))};
+    }
+
+    [[nodiscard]] triangle transformed(const transform& t) const
+    {
+        return {t.point(v0), t.point(v1), t.point(v2)};
+    }
+
     // [[nodiscard]] bool contains_point(const vector3& p) const
     // {
     //     const vector3 n = normal();
@@ -0,0 +1,44 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - triangle_record.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_TRIANGLE_RECORD
+#define RAY_TRACER_TRIANGLE_RECORD
+
+#include "components/math/aabb.hpp"
+#include "components/math/vector3.hpp"
+#include "triangle.hpp"
+
+// A triangle prepared for intersection: the edges from v0 and the unit normal
+// are computed once when the scene is built instead of in every ray test.
+// Built from a triangle it gives the same results as testing that triangle.
+struct triangle_record
+{
+    vector3 v0;
+    vector3 edge1; // v1 - v0
+    vector3 edge2; // v2 - v0
+    vector3 normal; // cross(edge1, edge2), normalized
+
+
+    triangle_record() = default;
+    explicit triangle_record(const triangle& t)
+        : v0(t.v0), edge1(t.v1 - t.v0), edge2(t.v2 - t.v0), normal(vector3::cross(edge1, edge2).normalized()) {}
+
+
+    // vertices back from the edges, exact up to the rounding of v0 + edge
+    [[nodiscard]] triangle to_triangle() const
+    {
+        return {v0, v0 + edge1, v0 + edge2};
+    }
+
+    [[nodiscard]] aabb bounds() const
+    {
+        return to_triangle().bounds();
+    }
+};
+
+#endif // RAY_TRACER_TRIANGLE_RECORD
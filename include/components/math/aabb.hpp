@@ -0,0 +1,80 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - aabb.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_AABB
+#define RAY_TRACER_AABB
+
+#include <cfloat>
+
+#include "vector3.hpp"
+
+struct aabb
+{
+    // default box is "inverted" so that expanding it with anything yields that thing
+    vector3 min{FLT_MAX, FLT_MAX, FLT_MAX};
+    vector3 max{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+
+    aabb() = default;
+    aabb(const vector3& min, const vector3& max) : min(min), max(max) {}
+
+
+    void expand(const vector3& p) { min = vector3::min(min, p); max = vector3::max(max, p); }
+    void expand(const aabb& b) { min = vector3::min(min, b.min); max = vector3::max(max, b.max); }
+
+
+    [[nodiscard]] bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+    [[nodiscard]] vector3 extent() const { return max - min; }
+    [[nodiscard]] vector3 centroid() const { return (min + max) * 0.5f; }
+
+    [[nodiscard]] float surface_area() const
+    {
+        if (empty()) return 0.0f;
+        const vector3 e = extent();
+        return 2.0f * (e.x*e.y + e.y*e.z + e.z*e.x);
+    }
+
+    // axis with the largest extent, 0 = x, 1 = y, 2 = z
+    [[nodiscard]] int longest_axis() const
+    {
+        const vector3 e = extent();
+        if (e.x > e.y && e.x > e.z) return 0;
+        return e.y > e.z ? 1 : 2;
+    }
+
+
+    static aabb merge(const aabb& a, const aabb& b)
+    {
+        return {vector3::min(a.min, b.min), vector3::max(a.max, b.max)};
+    }
+};
+
+// three plain floats, 12 bytes even where vector3 is a padded float4
+struct packed_vector3
+{
+    float x, y, z;
+
+    packed_vector3(const vector3& v) : x(v.x), y(v.y), z(v.z) {}
+    operator vector3() const { return {x, y, z}; }
+};
+
+// An aabb stored in 24 bytes whatever vector3's layout, for arrays where the size decides how many
+// fit a cache line, like the BVH nodes. Converts to and from aabb; the arithmetic stays there.
+struct packed_aabb
+{
+    packed_vector3 min;
+    packed_vector3 max;
+
+    packed_aabb() : packed_aabb(aabb()) {}
+    packed_aabb(const aabb& b) : min(b.min), max(b.max) {}
+    operator aabb() const { return {min, max}; }
+
+    [[nodiscard]] float surface_area() const { return aabb(*this).surface_area(); }
+};
+
+#endif // RAY_TRACER_AABB
@@ -0,0 +1,29 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - hit_record.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_HIT_RECORD
+#define RAY_TRACER_HIT_RECORD
+
+#include <cstdint>
+
+// What a closest hit search carries while it runs: the distance, which primitive
+// (and instance) is hit there, and for triangles the barycentrics of v1 and v2.
+// Position, normals, uvs and material are only worked out for the final one.
+struct hit_record
+{
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    float t{1e30f};         // also the t_max that prunes the search
+    uint32_t prim{NONE};     // primitive id, in the instance's prototype when instance is set
+    uint32_t instance{NONE};
+    float u{0.0f}, v{0.0f};
+
+    [[nodiscard]] bool found() const { return prim != NONE; }
+};
+
+#endif // RAY_TRACER_HIT_RECORD
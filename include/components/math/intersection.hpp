@@ -9,13 +9,16 @@
 #ifndef RAY_TRACER_INTERSECTION_COMPONENT
 #define RAY_TRACER_INTERSECTION_COMPONENT
 #include <cfloat>
+#include "vector2.hpp"
 #include "vector3.hpp"
 
 struct intersection
 {
     float intersection_distance{FLT_MAX};
-    vector3 normal;
+    vector3 normal; // shading normal, turned towards the side the ray came from
     bool back_face{false};
+    vector3 position; // filled in by the scene's surface step, not by the shape tests
+    vector2 uv;
 };
 
 #endif//RAY_TRACER_INTERSECTION_COMPONENT
\ No newline at end of file
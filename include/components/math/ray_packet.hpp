@@ -0,0 +1,62 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - ray_packet.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_RAY_PACKET
+#define RAY_TRACER_RAY_PACKET
+
+#include <cstdint>
+
+#include "ray.hpp"
+
+// N rays in SoA form so one SIMD register holds the same component of 4 (or 8) rays.
+// Lanes past the rays given to the constructor are inactive and never hit.
+template <int N>
+struct alignas(32) ray_packet
+{
+    static_assert(N % 4 == 0 && N <= 32, "packets are tested 4 rays at a time and tracked in a 32-bit mask");
+    static constexpr uint32_t NO_PRIM = UINT32_MAX;
+
+    float ox[N], oy[N], oz[N];
+    float dx[N], dy[N], dz[N];
+    float ix[N], iy[N], iz[N]; // 1 / direction
+    float t_max[N];
+    uint32_t prim[N]; // closest primitive so far, NO_PRIM for none
+    float u[N], v[N]; // its barycentrics, for triangles
+    uint32_t active{0};
+
+
+    ray_packet(const ray* rays, const int count)
+    {
+        for (int i = 0; i < N; i++)
+        {
+            // inactive lanes copy the first ray so every lane holds valid numbers
+            const ray& r = rays[i < count ? i : 0];
+            ox[i] = r.origin.x; oy[i] = r.origin.y; oz[i] = r.origin.z;
+            dx[i] = r.direction.x; dy[i] = r.direction.y; dz[i] = r.direction.z;
+            ix[i] = 1.0f / dx[i]; iy[i] = 1.0f / dy[i]; iz[i] = 1.0f / dz[i];
+            t_max[i] = i < count ? 1e30f : -1.0f;
+            prim[i] = NO_PRIM;
+            u[i] = v[i] = 0.0f;
+            if (i < count) active |= 1u << i;
+        }
+    }
+
+    // true when every ray has the same direction signs, so one near-to-far child order suits them all
+    [[nodiscard]] bool coherent() const
+    {
+        for (int i = 1; i < N; i++)
+        {
+            if (!(active >> i & 1u)) continue;
+            if ((dx[i] < 0.0f) != (dx[0] < 0.0f) || (dy[i] < 0.0f) != (dy[0] < 0.0f) || (dz[i] < 0.0f) != (dz[0] < 0.0f))
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif // RAY_TRACER_RAY_PACKET
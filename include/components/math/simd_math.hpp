@@ -0,0 +1,32 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - simd_math.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_SIMD_MATH_LAYOUT
+#define RAY_TRACER_SIMD_MATH_LAYOUT
+
+// Compile-time layout of vector3 and color. Build with -DRAY_TRACER_SIMD_MATH (the
+// RAY_TRACER_SIMD_MATH cmake option) to store both as a 16-byte aligned float4 and do
+// their arithmetic in SSE registers; otherwise, or without SSE, they stay three packed
+// floats. The API and the results are the same either way, the fourth lane is padding.
+#if defined(RAY_TRACER_SIMD_MATH) && (defined(__SSE2__) || defined(_M_X64))
+#define RAY_TRACER_SIMD_VECTOR 1
+#include <emmintrin.h>
+#else
+#define RAY_TRACER_SIMD_VECTOR 0
+#endif
+
+#if RAY_TRACER_SIMD_VECTOR
+// (x + y) + z of a register, the order the scalar code adds in
+inline float horizontal_sum3(const __m128 v)
+{
+    const __m128 xy = _mm_add_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(_mm_add_ss(xy, _mm_movehl_ps(v, v)));
+}
+#endif
+
+#endif // RAY_TRACER_SIMD_MATH_LAYOUT
@@ -0,0 +1,140 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - transform.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_TRANSFORM
+#define RAY_TRACER_TRANSFORM
+
+#include <cmath>
+
+#include "vector3.hpp"
+
+// Affine transform stored as the top 3 rows of a 4x4 matrix (rotation/scale in
+// the left 3 columns, translation in the last one).
+struct transform
+{
+    float m[3][4]{{1,0,0,0}, {0,1,0,0}, {0,0,1,0}};
+
+
+    transform() = default;
+
+
+    [[nodiscard]] vector3 point(const vector3& p) const
+    {
+        return {
+            m[0][0]*p.x + m[0][1]*p.y + m[0][2]*p.z + m[0][3],
+            m[1][0]*p.x + m[1][1]*p.y + m[1][2]*p.z + m[1][3],
+            m[2][0]*p.x + m[2][1]*p.y + m[2][2]*p.z + m[2][3]
+        };
+    }
+
+    [[nodiscard]] vector3 vector(const vector3& v) const
+    {
+        return {
+            m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z,
+            m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z,
+            m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z
+        };
+    }
+
+    // multiplies by the transposed 3x3 part, on an inverse transform this carries normals over
+    [[nodiscard]] vector3 transposed_vector(const vector3& v) const
+    {
+        return {
+            m[0][0]*v.x + m[1][0]*v.y + m[2][0]*v.z,
+            m[0][1]*v.x + m[1][1]*v.y + m[2][1]*v.z,
+            m[0][2]*v.x + m[1][2]*v.y + m[2][2]*v.z
+        };
+    }
+
+    // largest factor any direction is stretched by, used to scale radii
+    [[nodiscard]] float max_scale() const
+    {
+        const float sx = vector3(m[0][0], m[1][0], m[2][0]).length();
+        const float sy = vector3(m[0][1], m[1][1], m[2][1]).length();
+        const float sz = vector3(m[0][2], m[1][2], m[2][2]).length();
+        return std::fmax(sx, std::fmax(sy, sz));
+    }
+
+    // true when the 3x3 part only rotates, mirrors and scales uniformly (orthogonal columns of one
+    // length), so spheres stay spheres and areas all grow by the same factor
+    [[nodiscard]] bool is_similarity(const float tolerance = 1e-4f) const
+    {
+        const vector3 cx(m[0][0], m[1][0], m[2][0]), cy(m[0][1], m[1][1], m[2][1]), cz(m[0][2], m[1][2], m[2][2]);
+        const float s_2 = (cx.length_2() + cy.length_2() + cz.length_2()) / 3.0f;
+        const float eps = tolerance * s_2;
+        return std::fabs(cx.length_2() - s_2) <= eps && std::fabs(cy.length_2() - s_2) <= eps &&
+               std::fabs(cz.length_2() - s_2) <= eps && std::fabs(vector3::dot(cx, cy)) <= eps &&
+               std::fabs(vector3::dot(cx, cz)) <= eps && std::fabs(vector3::dot(cy, cz)) <= eps;
+    }
+
+    // applies o first, then this
+    transform operator*(const transform& o) const
+    {
+        transform r;
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                r.m[i][j] = m[i][0]*o.m[0][j] + m[i][1]*o.m[1][j] + m[i][2]*o.m[2][j] + (j == 3 ? m[i][3] : 0.0f);
+            }
+        }
+        return r;
+    }
+
+    [[nodiscard]] transform inverse() const
+    {
+        // inverse of the 3x3 part via cofactors, then the translation follows from it
+        const float a = m[0][0], b = m[0][1], c = m[0][2];
+        const float d = m[1][0], e = m[1][1], f = m[1][2];
+        const float g = m[2][0], h = m[2][1], i = m[2][2];
+
+        const float A = e*i - f*h, B = -(d*i - f*g), C = d*h - e*g;
+        const float inv_det = 1.0f / (a*A + b*B + c*C);
+
+        transform r;
+        r.m[0][0] = A * inv_det;  r.m[0][1] = -(b*i - c*h) * inv_det; r.m[0][2] = (b*f - c*e) * inv_det;
+        r.m[1][0] = B * inv_det;  r.m[1][1] = (a*i - c*g) * inv_det;  r.m[1][2] = -(a*f - c*d) * inv_det;
+        r.m[2][0] = C * inv_det;  r.m[2][1] = -(a*h - b*g) * inv_det; r.m[2][2] = (a*e - b*d) * inv_det;
+
+        const vector3 t = r.vector(vector3(m[0][3], m[1][3], m[2][3]));
+        r.m[0][3] = -t.x; r.m[1][3] = -t.y; r.m[2][3] = -t.z;
+        return r;
+    }
+
+
+    static transform translation(const vector3& t)
+    {
+        transform r;
+        r.m[0][3] = t.x; r.m[1][3] = t.y; r.m[2][3] = t.z;
+        return r;
+    }
+
+    static transform scale(const vector3& s)
+    {
+        transform r;
+        r.m[0][0] = s.x; r.m[1][1] = s.y; r.m[2][2] = s.z;
+        return r;
+    }
+
+    static transform scale(const float s) { return scale(vector3(s, s, s)); }
+
+    // rotation of angle radians around axis, right handed
+    static transform rotation(const vector3& axis, const float angle)
+    {
+        const vector3 a = axis.normalized();
+        const float s = std::sin(angle), c = std::cos(angle), t = 1.0f - c;
+
+        transform r;
+        r.m[0][0] = t*a.x*a.x + c;     r.m[0][1] = t*a.x*a.y - s*a.z; r.m[0][2] = t*a.x*a.z + s*a.y;
+        r.m[1][0] = t*a.x*a.y + s*a.z; r.m[1][1] = t*a.y*a.y + c;     r.m[1][2] = t*a.y*a.z - s*a.x;
+        r.m[2][0] = t*a.x*a.z - s*a.y; r.m[2][1] = t*a.y*a.z + s*a.x; r.m[2][2] = t*a.z*a.z + c;
+        return r;
+    }
+};
+
+#endif // RAY_TRACER_TRANSFORM
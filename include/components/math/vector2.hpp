@@ -0,0 +1,26 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - vector2.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_VECTOR2
+#define RAY_TRACER_VECTOR2
+
+struct vector2
+{
+    float x, y;
+
+
+    vector2() : x(0), y(0) {}
+    vector2(const float x, const float y) : x(x), y(y) {}
+
+
+    vector2 operator+(const vector2& o) const { return {x + o.x, y + o.y}; }
+    vector2 operator-(const vector2& o) const { return {x - o.x, y - o.y}; }
+    vector2 operator*(const float t) const { return {x * t, y * t}; }
+};
+
+#endif // RAY_TRACER_VECTOR2
@@ -11,6 +11,32 @@
 
 #include <cmath>
 
+#include "components/math/simd_math.hpp"
+
+#if RAY_TRACER_SIMD_VECTOR
+struct alignas(16) vector3
+{
+    // the register itself is the storage, so values stay in it between operations
+    union
+    {
+        struct { float x, y, z, w; }; // w is padding, never read
+        __m128 v;
+    };
+
+
+    vector3() : v(_mm_setzero_ps()) {}
+    vector3(const float x, const float y, const float z) : v(_mm_setr_ps(x, y, z, 0.0f)) {}
+    explicit vector3(const __m128 v) : v(v) {}
+    [[nodiscard]] __m128 simd() const { return v; }
+
+    vector3 operator+(const vector3& o) const { return vector3(_mm_add_ps(simd(), o.simd())); }
+    vector3 operator-(const vector3& o) const { return vector3(_mm_sub_ps(simd(), o.simd())); }
+    vector3 operator*(const float t) const { return vector3(_mm_mul_ps(simd(), _mm_set1_ps(t))); }
+    vector3 operator/(const float t) const { return vector3(_mm_div_ps(simd(), _mm_set1_ps(t))); }
+    vector3 operator-() const { return vector3(_mm_xor_ps(simd(), _mm_set1_ps(-0.0f))); }
+    vector3& operator+=(const vector3& o) { return *this = *this + o; }
+    vector3& operator*=(const float t) { return *this = *this * t; }
+#else
 struct vector3
 {
     float x, y, z;
@@ -27,29 +53,51 @@ struct vector3
     vector3 operator-() const { return {-x, -y, -z}; }
     vector3& operator+=(const vector3& o) { x += o.x; y += o.y; z += o.z; return *this; }
     vector3& operator*=(const float t) { x *= t; y *= t; z *= t; return *this; }
+#endif
     vector3 operator%(const vector3& o) const { return cross(*this,o); }
     void normalize() { (*this) = this->normalized(); }
+    float operator[](const int i) const { return (&x)[i]; } // 0 = x, 1 = y, 2 = z
 
 
-    [[nodiscard]] float length() const { return std::sqrt(x*x + y*y + z*z); }
-    [[nodiscard]] float length_2() const { return x*x + y*y + z*z; } // squared length
+    [[nodiscard]] float length() const { return std::sqrt(length_2()); }
+    [[nodiscard]] float length_2() const { return dot(*this, *this); } // squared length
     [[nodiscard]] vector3 normalized() const { const float len = length(); return *this / len; }
 
     [[nodiscard]] vector3 cross(const vector3& b) const
     {
-        return {y*b.z - z*b.y,z*b.x - x*b.z,x*b.y - y*b.x};
+        return cross(*this, b);
     }
 
 
+#if RAY_TRACER_SIMD_VECTOR
+    static float dot(const vector3& a, const vector3& b) { return horizontal_sum3(_mm_mul_ps(a.simd(), b.simd())); }
+    static vector3 cross(const vector3& a, const vector3& b)
+    {
+        // a.yzx * b.zxy - a.zxy * b.yzx
+        const __m128 va = a.simd();
+        const __m128 vb = b.simd();
+        const __m128 a_yzx = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 b_yzx = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+        const __m128 a_zxy = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 1, 0, 2));
+        const __m128 b_zxy = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 1, 0, 2));
+        return vector3(_mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+    }
+#else
     static float dot(const vector3& a, const vector3& b) { return a.x*b.x + a.y*b.y + a.z*b.z; }
     static vector3 cross(const vector3& a, const vector3& b)
     {
         return {a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x};
     }
+#endif
     static vector3 reflect(const vector3& v, const vector3& n) { return v - n * (2.0f * dot(v,n)); }
     static vector3 lerp(const vector3& a, const vector3& b, float t) { return a*(1-t) + b*t; }
     static float distance(const vector3& a, const vector3& b) { return (a-b).length(); }
     static float distance_2(const vector3& a, const vector3& b) { return (a-b).length_2(); }
+#if RAY_TRACER_SIMD_VECTOR
+    // same operand order as the scalar compares, so NaNs come out the same way
+    static vector3 min(const vector3& a, const vector3& b) { return vector3(_mm_min_ps(a.simd(), b.simd())); }
+    static vector3 max(const vector3& a, const vector3& b) { return vector3(_mm_max_ps(a.simd(), b.simd())); }
+#else
     static vector3 min(const vector3& a, const vector3& b)
     {
         return { a.x<b.x?a.x:b.x, a.y<b.y?a.y:b.y, a.z<b.z?a.z:b.z };
@@ -58,6 +106,7 @@ struct vector3
     {
         return { a.x>b.x?a.x:b.x, a.y>b.y?a.y:b.y, a.z>b.z?a.z:b.z };
     }
+#endif
     static vector3 random(const float radius = 1.0f)
     {
         const float u = static_cast<float>(rand()) / RAND_MAX;
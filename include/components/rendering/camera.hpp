@@ -54,6 +54,18 @@ struct camera
         }
         return ray(pos, dir);
     }
+
+    // image coordinates of p as generate_ray takes them, through the centre of the lens;
+    // false for points behind the camera
+    bool project(const vector3& p, float& u, float& v) const
+    {
+        const vector3 d = p - pos;
+        const float z = vector3::dot(d, forward);
+        if (z <= 0.0f) return false;
+        u = (vector3::dot(d, right) / (z * fov * aspect) + 1.0f) * 0.5f;
+        v = (1.0f - vector3::dot(d, up) / (z * fov)) * 0.5f;
+        return true;
+    }
 };
 
 #endif //RAY_TRACER_CAMERA
@@ -12,6 +12,32 @@
 #include <algorithm>
 #include <cstdint>
 
+#include "components/math/simd_math.hpp"
+
+// float4 with SSE arithmetic under RAY_TRACER_SIMD_MATH, like vector3
+#if RAY_TRACER_SIMD_VECTOR
+struct alignas(16) color
+{
+    union
+    {
+        struct { float r, g, b, a; }; // a is padding, never read
+        __m128 v;
+    };
+
+    color() : v(_mm_setzero_ps()) {}
+    color(const float r, const float g, const float b) : v(_mm_setr_ps(r, g, b, 0.0f)) {}
+    explicit color(const float x) : v(_mm_setr_ps(x, x, x, 0.0f)) {}
+    explicit color(const __m128 v) : v(v) {}
+    [[nodiscard]] __m128 simd() const { return v; }
+
+    color operator+(const color& o) const { return color(_mm_add_ps(simd(), o.simd())); }
+    color operator*(const float t) const { return color(_mm_mul_ps(simd(), _mm_set1_ps(t))); }
+    color operator*(const color& o) const { return color(_mm_mul_ps(simd(), o.simd())); }
+    color& operator*=(const float x) { return *this = *this * x; }
+    color& operator+=(const color& o) { return *this = *this + o; }
+    color& operator/=(const float x) { return *this = *this / x; }
+    color operator/(const float x) const { return color(_mm_div_ps(simd(), _mm_set1_ps(x))); }
+#else
 struct color
 {
     float r, g, b;
@@ -27,6 +53,7 @@ struct color
     color& operator+=(const color& o) { r+=o.r; g+=o.g; b+=o.b; return *this; }
     color& operator/=(const float x) { r /= x;g /= x;b /= x; return *this; }
     color operator/(const float x) const { return {r / x, g / x, b / x }; }
+#endif
 
     static color from_bytes(const uint8_t r, const uint8_t g, const uint8_t b)
     {
@@ -43,11 +70,16 @@ struct color
 
     [[nodiscard]] color clamped(const float min = 0.0f, const float max = 1.0f) const
     {
+#if RAY_TRACER_SIMD_VECTOR
+        // operands ordered like std::min / std::max, so NaNs come out the same way
+        return color(_mm_min_ps(_mm_set1_ps(max), _mm_max_ps(_mm_set1_ps(min), simd())));
+#else
         return {
             std::min(std::max(r, min), max),
             std::min(std::max(g, min), max),
             std::min(std::max(b, min), max)
         };
+#endif
     }
 
     [[nodiscard]] float luminance() const
@@ -0,0 +1,110 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - light_list.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_LIGHT_LIST
+#define RAY_TRACER_LIGHT_LIST
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+#include "components/acceleration/light_bvh.hpp"
+#include "components/geometry/sphere.hpp"
+#include "components/geometry/triangle.hpp"
+#include "components/rendering/color.hpp"
+
+// one emissive primitive, in world space
+struct emitter
+{
+    std::variant<triangle, sphere> shape;
+    color emission;
+    float area;
+
+    // what the light BVH is built from: spheres face every way, triangles light along their normal
+    [[nodiscard]] light_bounds bounds() const
+    {
+        light_bounds b;
+        b.power = emission.luminance() * area;
+        if (const auto* t = std::get_if<triangle>(&shape))
+        {
+            b.bounds = t->bounds();
+            b.cone = {t->normal(), 1.0f};
+        }
+        else
+        {
+            b.bounds = std::get<sphere>(shape).bounds();
+            b.cone = normal_cone::every_direction();
+        }
+        return b;
+    }
+};
+
+// Every emissive primitive of a scene, instanced ones included, gathered when its
+// acceleration is built. pick() chooses an emitter with probability proportional to its
+// area, so a uniform point on the picked one is uniform over all emitting surface; the
+// light BVH over the same emitters chooses by what they send to a given point instead.
+struct light_list
+{
+    std::vector<emitter> emitters;
+    std::vector<float> cdf; // area of emitters [0, i]
+    float total_area = 0.0f;
+
+    // false for degenerate shapes, which are left out
+    bool add(const std::variant<triangle, sphere>& shape, const color& emission)
+    {
+        const float area = std::visit([](const auto& s) { return surface_area(s); }, shape);
+        if (area <= 0.0f) return false;
+        emitters.push_back({shape, emission, area});
+        total_area += area;
+        cdf.push_back(total_area);
+        return true;
+    }
+
+    void clear()
+    {
+        emitters.clear();
+        cdf.clear();
+        total_area = 0.0f;
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return emitters.empty();
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return emitters.size();
+    }
+
+    // index of the emitter a uniform u in [0, 1) picks
+    [[nodiscard]] uint32_t pick(const float u) const
+    {
+        const auto it = std::upper_bound(cdf.begin(), cdf.end(), u * total_area);
+        return static_cast<uint32_t>(std::min(static_cast<size_t>(it - cdf.begin()), emitters.size() - 1));
+    }
+
+    // probability of pick() returning emitter i
+    [[nodiscard]] float pmf(const uint32_t i) const
+    {
+        return emitters[i].area / total_area;
+    }
+
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        return emitters.size() * sizeof(emitter) + cdf.size() * sizeof(float);
+    }
+
+private:
+    static float surface_area(const triangle& t) { return t.area(); }
+    static float surface_area(const sphere& s) { return 4.0f * static_cast<float>(M_PI) * s.radius * s.radius; }
+};
+
+#endif // RAY_TRACER_LIGHT_LIST
@@ -19,6 +19,8 @@ struct material
 
     material() : albedo(1.0f, 0.75f, 0.8f) {}
     material(const color& c, const float r, const color& e=color(0,0,0)) : albedo(c), reflectivity(r), emission(e) {}
+
+    [[nodiscard]] bool emissive() const { return emission.r > 0.0f || emission.g > 0.0f || emission.b > 0.0f; }
 };
 
 #endif // RAY_TRACER_MATERIAL
@@ -0,0 +1,57 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - material_table.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_MATERIAL_TABLE
+#define RAY_TRACER_MATERIAL_TABLE
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "components/rendering/material.hpp"
+
+// index into a scene's material_table
+using material_id = uint16_t;
+
+// Every material of a scene stored once. Primitives and instances keep a
+// material_id instead of a copy, so shading can also group hits by it.
+struct material_table
+{
+    static constexpr size_t MAX_MATERIALS = size_t{UINT16_MAX} + 1;
+
+    std::vector<material> materials;
+
+    material_id add(const material& m)
+    {
+        if (materials.size() >= MAX_MATERIALS) throw std::length_error("material_table: out of 16-bit material ids");
+        materials.push_back(m);
+        return static_cast<material_id>(materials.size() - 1);
+    }
+
+    [[nodiscard]] const material& operator[](const material_id id) const
+    {
+        return materials[id];
+    }
+
+    [[nodiscard]] material& operator[](const material_id id)
+    {
+        return materials[id];
+    }
+
+    [[nodiscard]] size_t size() const
+    {
+        return materials.size();
+    }
+
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        return materials.size() * sizeof(material);
+    }
+};
+
+#endif // RAY_TRACER_MATERIAL_TABLE
@@ -0,0 +1,37 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - path_state.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_PATH_STATE
+#define RAY_TRACER_PATH_STATE
+
+#include "components/math/ray.hpp"
+#include "components/math/vector3.hpp"
+#include "components/rendering/color.hpp"
+
+// What a path carries from one hit to the next, as scene::scatter updates it.
+struct path_state
+{
+    color radiance{0.0f};    // gathered so far, towards the camera
+    color throughput{1.0f};  // of the bounces so far
+    float bounce_pdf{0.0f};  // density the last diffuse bounce picked the ray with, 0 for camera rays and mirrors
+    vector3 bounce_normal;   // where the ray was cast, for the light BVH's pick probability there
+    int depth{0};            // bounces so far
+    int resampled_depth{-1}; // the hit whose direct light the caller estimates itself, -1 for none
+};
+
+// The shadow ray of a light sample: contribution joins the path's radiance when nothing blocks
+// r before t_max. pending is false when the hit took no light sample.
+struct shadow_query
+{
+    ray r;
+    float t_max{0.0f};
+    color contribution;
+    bool pending{false};
+};
+
+#endif // RAY_TRACER_PATH_STATE
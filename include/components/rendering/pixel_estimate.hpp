@@ -0,0 +1,52 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - pixel_estimate.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_PIXEL_ESTIMATE
+#define RAY_TRACER_PIXEL_ESTIMATE
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "color.hpp"
+
+// The samples of one pixel so far: their sum, and the running mean and variance of their
+// luminance (Welford's update), which tell how far the mean may still be off.
+struct pixel_estimate
+{
+    color sum{0.0f};
+    uint32_t count{0};
+    float mean_luminance{0.0f};
+    float m2{0.0f}; // sum of squared differences from the mean
+
+    void add(const color& sample)
+    {
+        sum += sample;
+        count++;
+        const float l = sample.luminance();
+        const float delta = l - mean_luminance;
+        mean_luminance += delta / static_cast<float>(count);
+        m2 += delta * (l - mean_luminance);
+    }
+
+    [[nodiscard]] color mean() const
+    {
+        return count ? sum / static_cast<float>(count) : color(0.0f);
+    }
+
+    // standard error of the mean luminance over the mean, floored so black pixels count as converged
+    // rather than infinitely noisy; 0 with no variance at all
+    [[nodiscard]] float relative_error() const
+    {
+        if (count < 2) return INFINITY;
+        const float variance = m2 / static_cast<float>(count - 1);
+        return std::sqrt(variance / static_cast<float>(count)) / std::max(std::fabs(mean_luminance), 1e-3f);
+    }
+};
+
+#endif // RAY_TRACER_PIXEL_ESTIMATE
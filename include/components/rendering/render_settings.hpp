@@ -7,6 +7,8 @@
 #ifndef RAY_TRACER_RENDER_SETTINGS
 #define RAY_TRACER_RENDER_SETTINGS
 
+#include "systems/platform/cpu_features.hpp"
+
 enum class debug
 {
     off,
@@ -15,13 +17,56 @@ enum class debug
     depth
 };
 
+// acceleration structure scene::trace_ray walks
+enum class traversal_backend
+{
+    binary,
+    bvh4, // 4-wide nodes, SSE child tests
+    bvh8  // 8-wide nodes, AVX2 child tests
+};
+
+// how scene::build_acceleration builds the binary BVH
+enum class bvh_build_method
+{
+    sah_sweep,  // full SAH sweep, single threaded
+    binned_sah, // binned SAH, parallel over the thread pool
+    lbvh30,     // Morton-sorted linear BVH with 30-bit codes, fastest build for previews
+    lbvh63      // same with 63-bit codes, for scenes too large or uneven for 10 bits per axis
+};
+
+// how direct light sampling picks the emitter to send a shadow ray to
+enum class light_selection
+{
+    by_area,      // proportional to area, the same for every shading point
+    by_importance // through the light BVH, by what each emitter can send to the shading point
+};
+
 struct render_settings
 {
     debug debug = debug::normal;
     bool multithreaded = true;
     bool cosine_hemisphere = true;
+    traversal_backend traversal = traversal_backend::binary;
+    bvh_build_method builder = bvh_build_method::binned_sah;
+    float bvh_rebuild_ratio = 1.5f; // scene::update_acceleration rebuilds once refits grow the SAH cost past this
+    int packet_size = 8; // primary rays traced as one packet, 8 or 16; anything else traces them one at a time
+    isa kernel_isa = detect_isa(); // SIMD level of the intersection and traversal kernels, lower it to compare
+    bool wavefront = false; // trace stage by stage over batches of paths (wavefront_renderer) instead of a path per call
+    int wavefront_paths = 1 << 16; // paths in flight per wavefront batch
 
     int ssp = 64;
+    bool adaptive_sampling = false; // stop each pixel once it converges, ssp is then the average budget (adaptive_sampler)
+    int adaptive_min_ssp = 8;       // before a pixel's error is trusted, and per round after that
+    int adaptive_max_ssp = 512;
+    float adaptive_error = 0.02f;   // standard error of a pixel's mean luminance over that mean, to stop at
+    bool next_event_estimation = true; // sample the emitters with a shadow ray at every diffuse bounce
+    bool multiple_importance_sampling = true; // weight those against the bounces that hit emitters, else drop the bounces
+    light_selection light_picking = light_selection::by_importance;
+    bool reservoir_resampling = false; // ReSTIR direct light at the first diffuse hits, for previews at 1-4 ssp
+    int restir_candidates = 8;         // light samples resampled per pixel and pass
+    int restir_spatial_neighbours = 5; // reservoirs of nearby pixels reused per pass, 0 for none
+    float restir_spatial_radius = 30.0f; // in pixels
+    int restir_history_limit = 5;      // the previous pass counts for at most this many passes' candidates, 0 for no temporal reuse
     int max_bounces = 16;
     static render_settings global_settings;
 };
@@ -0,0 +1,37 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - reservoir.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_RESERVOIR
+#define RAY_TRACER_RESERVOIR
+
+#include "systems/rendering/light_sampling.hpp"
+
+// Weighted reservoir over light samples, for resampled importance sampling (ReSTIR): candidates
+// stream through update() and one survives with probability proportional to its weight. A
+// reservoir can itself be streamed into another as one candidate standing for all it has seen.
+struct reservoir
+{
+    light_sample y{};  // the sample kept
+    float w_sum{0.0f}; // resampling weights of every candidate seen
+    float m{0.0f};     // candidates seen, a float as reused reservoirs are capped
+    float w{0.0f};     // contribution weight of y, its estimate is f(y) * w; 0 with nothing kept
+
+    // streams in candidate with resampling weight weight, standing for count candidates; u is
+    // a uniform number in [0, 1). True when it replaced the sample kept so far.
+    bool update(const light_sample& candidate, const float weight, const float count, const float u)
+    {
+        m += count;
+        if (!(weight > 0.0f)) return false;
+        w_sum += weight;
+        if (u * w_sum >= weight) return false;
+        y = candidate;
+        return true;
+    }
+};
+
+#endif // RAY_TRACER_RESERVOIR
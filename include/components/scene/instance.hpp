@@ -0,0 +1,78 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - instance.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_INSTANCE
+#define RAY_TRACER_INSTANCE
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/geometry/mesh.hpp"
+#include "components/math/aabb.hpp"
+#include "components/math/transform.hpp"
+#include "components/rendering/material_table.hpp"
+#include "components/math/ray.hpp"
+#include "components/scene/object.hpp"
+#include "components/scene/primitive_store.hpp"
+
+// Geometry stored once in its own object space, with its own (bottom-level) BVH.
+struct prototype
+{
+    primitive_store prims;
+    bvh blas;
+    aabb bounds; // object space
+
+    explicit prototype(const std::vector<object>& objects) : prims(objects)
+    {
+        for (const auto& o : objects) bounds.expand(o.bounds());
+    }
+
+    prototype(mesh m, const material_id mat)
+    {
+        bounds = m.bounds();
+        prims.add_mesh(std::move(m), mat);
+    }
+};
+
+// One placement of a prototype. Costs a couple of transforms, not a copy of the geometry.
+struct instance
+{
+    uint32_t prototype_index;
+    transform to_world;
+    transform to_object; // inverse of to_world, kept so rays can be moved into object space
+    std::optional<material_id> material_override; // replaces every material of the prototype
+
+    instance(const uint32_t prototype_index, const transform& t, const std::optional<material_id> m = std::nullopt)
+        : prototype_index(prototype_index), to_world(t), to_object(t.inverse()), material_override(m) {}
+
+    // r in object space; the direction keeps its scale so t along it is still a world space distance
+    [[nodiscard]] ray object_ray(const ray& r) const
+    {
+        ray local;
+        local.origin = to_object.point(r.origin);
+        local.direction = to_object.vector(r.direction);
+        return local;
+    }
+
+    [[nodiscard]] aabb world_bounds(const aabb& object_bounds) const
+    {
+        aabb result;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            const vector3 p(corner & 1 ? object_bounds.max.x : object_bounds.min.x,
+                            corner & 2 ? object_bounds.max.y : object_bounds.min.y,
+                            corner & 4 ? object_bounds.max.z : object_bounds.min.z);
+            result.expand(to_world.point(p));
+        }
+        return result;
+    }
+};
+
+#endif //RAY_TRACER_INSTANCE
@@ -12,16 +12,21 @@
 
 #include "components/geometry/triangle.hpp"
 #include "components/geometry/sphere.hpp"
-#include "components/rendering/material.hpp"
+#include "components/rendering/material_table.hpp"
 
 struct object
 {
     std::variant<triangle,sphere> shape;
-    material mat;
+    material_id mat; // into the scene's material table
 
     template <typename Shape>
-    explicit object(Shape&& s, const material m)
+    explicit object(Shape&& s, const material_id m)
         : shape(std::forward<Shape>(s)), mat(m) {}
+
+    [[nodiscard]] aabb bounds() const
+    {
+        return std::visit([](auto const& s) { return s.bounds(); }, shape);
+    }
 };
 
 #endif //RAY_TRACER_OBJECT
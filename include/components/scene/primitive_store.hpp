@@ -0,0 +1,345 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - primitive_store.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_PRIMITIVE_STORE
+#define RAY_TRACER_PRIMITIVE_STORE
+
+#include <algorithm>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/geometry/mesh.hpp"
+#include "components/geometry/sphere.hpp"
+#include "components/geometry/triangle.hpp"
+#include "components/geometry/triangle_record.hpp"
+#include "components/math/aabb.hpp"
+#include "components/math/transform.hpp"
+#include "components/math/vector2.hpp"
+#include "components/rendering/material_table.hpp"
+#include "components/scene/object.hpp"
+
+// Scene primitives split by type into structure-of-arrays lanes, with the
+// material ids kept apart so intersection tests only pull in geometry.
+// Primitive ids are handed out in insertion order, like object indices were;
+// refs maps each id to its slot in the lanes of its type. Every triangle of
+// an added mesh is a primitive of its own, read from shared indexed buffers.
+struct primitive_store
+{
+    static constexpr uint32_t SPHERE_BIT = 1u << 31; // set in a ref when the slot is a sphere slot
+    static constexpr uint32_t MESH_BIT = 1u << 30;   // set in a ref when the slot is a mesh triangle
+
+    // triangles are kept as triangle_record lanes, prepared for intersection when written
+    struct triangle_lanes
+    {
+        std::vector<float> v0x, v0y, v0z;
+        std::vector<float> e1x, e1y, e1z; // v1 - v0
+        std::vector<float> e2x, e2y, e2z; // v2 - v0
+        std::vector<float> nx, ny, nz;    // unit normal
+
+        [[nodiscard]] size_t size() const { return v0x.size(); }
+
+        [[nodiscard]] triangle_record at(const uint32_t slot) const
+        {
+            triangle_record t;
+            t.v0 = {v0x[slot], v0y[slot], v0z[slot]};
+            t.edge1 = {e1x[slot], e1y[slot], e1z[slot]};
+            t.edge2 = {e2x[slot], e2y[slot], e2z[slot]};
+            t.normal = {nx[slot], ny[slot], nz[slot]};
+            return t;
+        }
+    };
+
+    struct sphere_lanes
+    {
+        std::vector<float> cx, cy, cz;
+        std::vector<float> radius;
+
+        [[nodiscard]] size_t size() const { return cx.size(); }
+
+        [[nodiscard]] sphere at(const uint32_t slot) const
+        {
+            return {{cx[slot], cy[slot], cz[slot]}, radius[slot]};
+        }
+    };
+
+    // the triangles of every added mesh, vertices stored once and shared through the index buffer
+    struct mesh_buffers
+    {
+        std::vector<vector3> positions;
+        std::vector<uint32_t> indices; // 3 per triangle, into positions
+
+        [[nodiscard]] size_t size() const { return indices.size() / 3; }
+    };
+
+    // where one added mesh sits in mesh_buffers, with its optional per-vertex attributes
+    struct mesh_range
+    {
+        uint32_t first_prim;
+        uint32_t first_triangle;
+        uint32_t triangle_count;
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        std::vector<vector3> normals;
+        std::vector<vector2> uvs;
+    };
+
+    triangle_lanes triangles;
+    sphere_lanes spheres;
+    mesh_buffers mesh_triangles;
+    std::vector<mesh_range> meshes;
+    std::vector<uint32_t> refs;         // per primitive
+    std::vector<material_id> material_ids; // per primitive, into the scene's material table
+
+
+    primitive_store() = default;
+
+    explicit primitive_store(const std::vector<object>& objects)
+    {
+        for (const auto& o : objects) add(o);
+    }
+
+    uint32_t add(const object& o)
+    {
+        const auto prim = static_cast<uint32_t>(refs.size());
+        refs.push_back(std::holds_alternative<sphere>(o.shape) ? push_sphere() | SPHERE_BIT : push_triangle());
+        set_shape(prim, o.shape);
+        material_ids.push_back(o.mat);
+        return prim;
+    }
+
+    // adds every triangle of m as a primitive sharing mat, returns the first primitive id
+    uint32_t add_mesh(mesh m, const material_id mat)
+    {
+        const auto first_prim = static_cast<uint32_t>(refs.size());
+        const auto first_triangle = static_cast<uint32_t>(mesh_triangles.size());
+        const auto first_vertex = static_cast<uint32_t>(mesh_triangles.positions.size());
+
+        mesh_triangles.positions.insert(mesh_triangles.positions.end(), m.positions.begin(), m.positions.end());
+        mesh_triangles.indices.reserve(mesh_triangles.indices.size() + m.indices.size());
+        for (const uint32_t i : m.indices) mesh_triangles.indices.push_back(first_vertex + i);
+
+        for (uint32_t i = 0; i < m.triangle_count(); i++)
+        {
+            refs.push_back((first_triangle + i) | MESH_BIT);
+            material_ids.push_back(mat);
+        }
+
+        meshes.push_back({first_prim, first_triangle, static_cast<uint32_t>(m.triangle_count()), first_vertex,
+                          static_cast<uint32_t>(m.positions.size()), std::move(m.normals), std::move(m.uvs)});
+        return first_prim;
+    }
+
+    [[nodiscard]] size_t size() const { return refs.size(); }
+
+    [[nodiscard]] static bool is_sphere(const uint32_t ref) { return ref & SPHERE_BIT; }
+    [[nodiscard]] static bool is_mesh(const uint32_t ref) { return ref & MESH_BIT; }
+    [[nodiscard]] static uint32_t slot(const uint32_t ref) { return ref & ~(SPHERE_BIT | MESH_BIT); }
+
+    // calls fn with the primitive's shape: a sphere, a triangle_record, or a triangle for mesh triangles
+    template <typename Fn>
+    decltype(auto) visit(const uint32_t prim, Fn&& fn) const
+    {
+        const uint32_t ref = refs[prim];
+        if (is_sphere(ref)) return fn(sphere_at(slot(ref)));
+        if (is_mesh(ref)) return fn(mesh_triangle_at(slot(ref)));
+        return fn(triangle_at(ref));
+    }
+
+    [[nodiscard]] triangle_record triangle_at(const uint32_t slot) const
+    {
+        return triangles.at(slot);
+    }
+
+    // how many of the count primitives listed in prims, from the first and at most 8, are triangles
+    // or spheres in consecutive slots, so they can be tested together straight from the lanes;
+    // reorder lays out each BVH leaf as at most one such run per type
+    [[nodiscard]] uint32_t lane_run(const uint32_t* prims, const uint32_t count) const
+    {
+        const uint32_t first = refs[prims[0]];
+        if (is_mesh(first)) return 1;
+
+        uint32_t n = 1;
+        while (n < count && n < 8 && refs[prims[n]] == first + n) n++;
+        return n;
+    }
+
+    [[nodiscard]] sphere sphere_at(const uint32_t slot) const
+    {
+        return spheres.at(slot);
+    }
+
+    [[nodiscard]] triangle mesh_triangle_at(const uint32_t slot) const
+    {
+        const uint32_t* i = &mesh_triangles.indices[3 * slot];
+        return {mesh_triangles.positions[i[0]], mesh_triangles.positions[i[1]], mesh_triangles.positions[i[2]]};
+    }
+
+    // the added mesh a mesh triangle slot belongs to
+    [[nodiscard]] const mesh_range& mesh_of(const uint32_t slot) const
+    {
+        const auto it = std::upper_bound(meshes.begin(), meshes.end(), slot,
+                                         [](const uint32_t s, const mesh_range& m) { return s < m.first_triangle; });
+        return *(it - 1);
+    }
+
+    // vertex normals of a mesh triangle blended at barycentrics (u, v), the face normal when the mesh has none
+    [[nodiscard]] vector3 mesh_normal(const uint32_t slot, const float u, const float v) const
+    {
+        const mesh_range& m = mesh_of(slot);
+        if (m.normals.empty()) return mesh_triangle_at(slot).normal();
+
+        const uint32_t* i = &mesh_triangles.indices[3 * slot];
+        return (m.normals[i[0] - m.first_vertex] * (1.0f - u - v) + m.normals[i[1] - m.first_vertex] * u
+              + m.normals[i[2] - m.first_vertex] * v).normalized();
+    }
+
+    [[nodiscard]] vector2 mesh_uv(const uint32_t slot, const float u, const float v) const
+    {
+        const mesh_range& m = mesh_of(slot);
+        if (m.uvs.empty()) return {u, v};
+
+        const uint32_t* i = &mesh_triangles.indices[3 * slot];
+        return m.uvs[i[0] - m.first_vertex] * (1.0f - u - v) + m.uvs[i[1] - m.first_vertex] * u
+             + m.uvs[i[2] - m.first_vertex] * v;
+    }
+
+    [[nodiscard]] std::variant<triangle,sphere> shape(const uint32_t prim) const
+    {
+        const uint32_t ref = refs[prim];
+        if (is_sphere(ref)) return sphere_at(slot(ref));
+        if (is_mesh(ref)) return mesh_triangle_at(slot(ref));
+        return triangle_at(slot(ref)).to_triangle();
+    }
+
+    // replaces the geometry of a primitive in place; a change of type, or of a mesh triangle, moves it
+    // to a new slot of its own and leaves the old slot unused
+    void set_shape(const uint32_t prim, const std::variant<triangle,sphere>& s)
+    {
+        if (const auto* t = std::get_if<triangle>(&s))
+        {
+            if (is_sphere(refs[prim]) || is_mesh(refs[prim])) refs[prim] = push_triangle();
+            write_triangle(refs[prim], triangle_record(*t));
+        }
+        else
+        {
+            if (!is_sphere(refs[prim])) refs[prim] = push_sphere() | SPHERE_BIT;
+            write_sphere(slot(refs[prim]), std::get<sphere>(s));
+        }
+    }
+
+    // moves every vertex (and normal) of an added mesh, its triangles keep their slots
+    void transform_mesh(const size_t mesh_index, const transform& t)
+    {
+        mesh_range& m = meshes[mesh_index];
+        for (uint32_t i = m.first_vertex; i < m.first_vertex + m.vertex_count; i++)
+            mesh_triangles.positions[i] = t.point(mesh_triangles.positions[i]);
+
+        const transform normal_transform = t.inverse();
+        for (auto& n : m.normals) n = normal_transform.transposed_vector(n).normalized();
+    }
+
+    // lays the lanes out again in the leaf order of b, which keeps the primitives of one leaf next
+    // to each other in every lane; each leaf of b is first grouped by type (the ref's top bits) so
+    // its primitives of one type get consecutive slots. Mesh triangles stay where they are, their
+    // index buffer is shared per mesh
+    void reorder(bvh& b)
+    {
+        for (const bvh_node& node : b.nodes)
+        {
+            if (!node.is_leaf()) continue;
+            const auto leaf = b.prim_indices.begin() + node.offset;
+            std::stable_sort(leaf, leaf + node.prim_count, [&](const uint32_t x, const uint32_t y)
+            {
+                return (refs[x] >> 30) < (refs[y] >> 30);
+            });
+        }
+
+        primitive_store sorted;
+        for (const uint32_t prim : b.prim_indices)
+        {
+            const uint32_t ref = refs[prim];
+            if (is_mesh(ref)) continue;
+            if (is_sphere(ref))
+            {
+                refs[prim] = sorted.push_sphere() | SPHERE_BIT;
+                sorted.write_sphere(slot(refs[prim]), sphere_at(slot(ref)));
+            }
+            else
+            {
+                refs[prim] = sorted.push_triangle();
+                sorted.write_triangle(refs[prim], triangle_at(ref));
+            }
+        }
+        triangles = std::move(sorted.triangles);
+        spheres = std::move(sorted.spheres);
+    }
+
+    [[nodiscard]] aabb bounds(const uint32_t prim) const
+    {
+        return visit(prim, [](const auto& shape) { return shape.bounds(); });
+    }
+
+    [[nodiscard]] material_id material_of(const uint32_t prim) const
+    {
+        return material_ids[prim];
+    }
+
+    // bytes of every array, for comparing against sizeof(object) per primitive
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        return geometry_bytes() + material_ids.size() * sizeof(material_id) + attribute_bytes();
+    }
+
+    // per-vertex normals and uvs of the meshes
+    [[nodiscard]] size_t attribute_bytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& m : meshes) bytes += m.normals.size() * sizeof(vector3) + m.uvs.size() * sizeof(vector2);
+        return bytes;
+    }
+
+    [[nodiscard]] size_t geometry_bytes() const
+    {
+        return triangles.size() * 12 * sizeof(float) + spheres.size() * 4 * sizeof(float)
+             + mesh_triangles.positions.size() * sizeof(vector3) + mesh_triangles.indices.size() * sizeof(uint32_t)
+             + refs.size() * sizeof(uint32_t);
+    }
+
+private:
+    uint32_t push_triangle()
+    {
+        for (auto* lane : {&triangles.v0x, &triangles.v0y, &triangles.v0z, &triangles.e1x, &triangles.e1y, &triangles.e1z,
+                           &triangles.e2x, &triangles.e2y, &triangles.e2z, &triangles.nx, &triangles.ny, &triangles.nz})
+            lane->push_back(0.0f);
+        return static_cast<uint32_t>(triangles.size() - 1);
+    }
+
+    uint32_t push_sphere()
+    {
+        for (auto* lane : {&spheres.cx, &spheres.cy, &spheres.cz, &spheres.radius}) lane->push_back(0.0f);
+        return static_cast<uint32_t>(spheres.size() - 1);
+    }
+
+    void write_triangle(const uint32_t i, const triangle_record& t)
+    {
+        triangles.v0x[i] = t.v0.x; triangles.v0y[i] = t.v0.y; triangles.v0z[i] = t.v0.z;
+        triangles.e1x[i] = t.edge1.x; triangles.e1y[i] = t.edge1.y; triangles.e1z[i] = t.edge1.z;
+        triangles.e2x[i] = t.edge2.x; triangles.e2y[i] = t.edge2.y; triangles.e2z[i] = t.edge2.z;
+        triangles.nx[i] = t.normal.x; triangles.ny[i] = t.normal.y; triangles.nz[i] = t.normal.z;
+    }
+
+    void write_sphere(const uint32_t i, const sphere& sp)
+    {
+        spheres.cx[i] = sp.center.x; spheres.cy[i] = sp.center.y; spheres.cz[i] = sp.center.z;
+        spheres.radius[i] = sp.radius;
+    }
+};
+
+#endif // RAY_TRACER_PRIMITIVE_STORE
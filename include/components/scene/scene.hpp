@@ -8,14 +8,45 @@
 
 #ifndef RAY_TRACER_SCENE
 #define RAY_TRACER_SCENE
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <span>
+#include <unordered_map>
 #include <vector>
 
+#include "components/acceleration/bvh.hpp"
+#include "components/acceleration/light_bvh.hpp"
+#include "components/acceleration/traversal_stats.hpp"
+#include "components/acceleration/wide_bvh.hpp"
+#include "components/geometry/mesh.hpp"
+#include "components/math/hit_record.hpp"
 #include "components/math/ray.hpp"
+#include "components/math/ray_packet.hpp"
+#include "components/math/transform.hpp"
+#include "components/rendering/light_list.hpp"
+#include "components/rendering/material_table.hpp"
+#include "components/rendering/path_state.hpp"
 #include "components/rendering/render_settings.hpp"
+#include "components/scene/instance.hpp"
 #include "components/scene/object.hpp"
+#include "components/scene/primitive_store.hpp"
+#include "systems/acceleration/binned_bvh_builder.hpp"
+#include "systems/acceleration/bvh_builder.hpp"
+#include "systems/acceleration/bvh_refitter.hpp"
+#include "systems/acceleration/bvh_traversal.hpp"
+#include "systems/acceleration/lbvh_builder.hpp"
+#include "systems/acceleration/light_bvh_builder.hpp"
+#include "systems/acceleration/packet_traversal.hpp"
+#include "systems/acceleration/wide_bvh_builder.hpp"
+#include "systems/acceleration/wide_bvh_traversal.hpp"
 #include "systems/math/intersection.hpp"
+#include "systems/math/packet_intersection.hpp"
+#include "systems/math/primitive_intersection.hpp"
+#include "systems/math/random.hpp"
+#include "systems/rendering/light_sampling.hpp"
+#include "systems/rendering/mis.hpp"
+#include "systems/threading/thread_pool.hpp"
 
 
 struct environment
@@ -25,80 +56,521 @@ struct environment
     color sky_color = color(0.1, 0.1, 0.2);
 };
 
+// bytes a scene holds, by what they are for
+struct scene_memory
+{
+    size_t geometry = 0;        // primitive lanes, mesh buffers and refs
+    size_t mesh_attributes = 0; // per-vertex normals and uvs
+    size_t material_ids = 0;    // one per primitive
+    size_t materials = 0;       // the material table
+    size_t acceleration = 0;    // nodes and leaf index lists of every BVH
+    size_t instancing = 0;      // prototype primitives and their BVHs, the placements and the TLAS
+    size_t lights = 0;          // world space copies of the emissive primitives and the light BVH over them
+
+    [[nodiscard]] size_t total() const
+    {
+        return geometry + mesh_attributes + material_ids + materials + acceleration + instancing + lights;
+    }
+};
+
 struct scene
 {
 public:
     environment environment;
 private:
-    std::vector<object> objects;
+    material_table materials; // shared by the objects, meshes, prototypes and instances
+    primitive_store prims; // the objects, split into per-type lanes
+    bvh accel;   // built by build_acceleration(), empty while the object list is dirty
+    bvh4 accel4; // collapsed from accel when render_settings::traversal asks for it
+    bvh8 accel8;
+    std::vector<uint32_t> wide_lanes; // binary node -> lane of accel4/accel8 mirroring it
+
+    // animation: objects changed since the last update_acceleration, and what a refit needs
+    std::vector<uint32_t> changed_objects;
+    std::vector<uint8_t> object_changed;
+    bvh_refit_data refit_data;
+
+    // instancing: shared prototypes, their placements and the top-level BVH over the placements
+    std::vector<prototype> prototypes;
+    std::vector<instance> instances;
+    bvh tlas;
+    bvh_refit_data tlas_refit_data;
+    std::vector<uint32_t> changed_instances;
+
+    light_list lights; // every emissive primitive, gathered with the acceleration
+    light_bvh light_tree;
+    std::unordered_map<uint64_t, uint32_t> emitter_of; // (instance, primitive) of a hit -> index in lights
 
 public:
+    // Stores a material once, objects and meshes then refer to it by the returned id.
+    material_id add_material(const material& m)
+    {
+        return materials.add(m);
+    }
+
+    [[nodiscard]] const material& material_at(const material_id id) const
+    {
+        return materials[id];
+    }
+
+    [[nodiscard]] size_t material_count() const
+    {
+        return materials.size();
+    }
+
     size_t add_object(const object& o)
     {
-        objects.push_back(o);
-        return objects.size() - 1;
+        prims.add(o);
+        object_changed.push_back(0);
+        accel = {};
+        accel4 = {};
+        accel8 = {};
+        refit_data = {};
+        return prims.size() - 1;
+    }
+
+    // Adds an indexed mesh as one object; each of its triangles gets its own BVH leaf entry.
+    // Returns the mesh index for transform_mesh.
+    size_t add_mesh(mesh m, const material_id mat)
+    {
+        prims.add_mesh(std::move(m), mat);
+        object_changed.resize(prims.size(), 0);
+        accel = {};
+        accel4 = {};
+        accel8 = {};
+        refit_data = {};
+        return prims.meshes.size() - 1;
+    }
+
+    // Moves every vertex of a mesh, picked up by the next update_acceleration.
+    void transform_mesh(const size_t mesh_index, const transform& t)
+    {
+        prims.transform_mesh(mesh_index, t);
+        const primitive_store::mesh_range& m = prims.meshes[mesh_index];
+        for (uint32_t prim = m.first_prim; prim < m.first_prim + m.triangle_count; prim++) mark_changed(prim);
+    }
+
+    // Registers geometry that can be placed many times with add_instance, in its own object space.
+    size_t add_prototype(const std::vector<object>& prototype_objects)
+    {
+        prototypes.emplace_back(prototype_objects);
+        tlas = {};
+        return prototypes.size() - 1;
+    }
+
+    // Registers a mesh that can be placed many times with add_instance.
+    size_t add_prototype(mesh m, const material_id mat)
+    {
+        prototypes.emplace_back(std::move(m), mat);
+        tlas = {};
+        return prototypes.size() - 1;
+    }
+
+    // Places a prototype; material_override, when set, replaces all of the prototype's materials.
+    size_t add_instance(const size_t prototype_index, const transform& to_world,
+                        const std::optional<material_id> material_override = std::nullopt)
+    {
+        instances.emplace_back(static_cast<uint32_t>(prototype_index), to_world, material_override);
+        tlas = {};
+        tlas_refit_data = {};
+        return instances.size() - 1;
+    }
+
+    // Moves an existing instance, picked up by the next update_acceleration.
+    void set_instance_transform(const size_t index, const transform& to_world)
+    {
+        instances[index].to_world = to_world;
+        instances[index].to_object = to_world.inverse();
+        if (std::find(changed_instances.begin(), changed_instances.end(), index) == changed_instances.end())
+            changed_instances.push_back(static_cast<uint32_t>(index));
+    }
+
+    // Moves an existing object, picked up by the next update_acceleration.
+    void transform_object(const size_t index, const transform& t)
+    {
+        std::visit([&](auto const& shape) { prims.set_shape(index, shape.transformed(t)); }, prims.shape(index));
+        mark_changed(index);
+    }
+
+    // Replaces the geometry (e.g. new vertices) of an existing object, picked up by the next update_acceleration.
+    void set_object_shape(const size_t index, const std::variant<triangle,sphere>& shape)
+    {
+        prims.set_shape(index, shape);
+        mark_changed(index);
+    }
+
+    // Per-frame update after transform_object / set_object_shape: refits the existing BVH where
+    // objects changed, and rebuilds it instead once its SAH cost has grown past
+    // render_settings::bvh_rebuild_ratio times the cost right after the last build.
+    bvh_refit_stats update_acceleration(thread_pool* pool = nullptr)
+    {
+        // after refit_instances, which may reorder new prototypes' primitives
+        const bool lights_moved = !changed_objects.empty() || !changed_instances.empty() || (tlas.empty() && !instances.empty());
+        refit_instances(pool);
+        if (lights_moved) build_lights();
+
+        bvh_refit_stats stats;
+        if (accel.empty() && prims.size() > 0)
+        {
+            build_acceleration(pool);
+            stats.rebuilt = true;
+            stats.sah_cost = accel.stats.sah_cost;
+            return stats;
+        }
+        if (changed_objects.empty()) return stats;
+
+        if (refit_data.empty()) refit_data = bvh_refitter::prepare(accel);
+
+        stats = bvh_refitter::refit(accel, refit_data, changed_objects,
+                                    [&](const uint32_t prim) { return prims.bounds(prim); }, pool);
+        if (!accel4.empty()) wide_bvh_builder::refit_lanes(accel4, wide_lanes, accel, refit_data.refitted);
+        if (!accel8.empty()) wide_bvh_builder::refit_lanes(accel8, wide_lanes, accel, refit_data.refitted);
+
+        for (const uint32_t i : changed_objects) object_changed[i] = 0;
+        changed_objects.clear();
+
+        if (stats.cost_ratio > render_settings::global_settings.bvh_rebuild_ratio)
+        {
+            build_acceleration(pool);
+            stats.rebuilt = true;
+            stats.sah_cost = accel.stats.sah_cost;
+        }
+        return stats;
+    }
+
+    // Builds the BVH over all objects, plus the wide variant the current traversal backend uses.
+    // Call after the last add_object and before rendering, without it trace_ray tests every object.
+    // render_settings::builder picks the builder, the parallel ones spread over pool when one is given.
+    const bvh_build_stats& build_acceleration(thread_pool* pool = nullptr)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<aabb> bounds(prims.size());
+        parallel_for(pool, 0, prims.size(), binned_bvh_builder::PARALLEL_GRAIN, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; i++) bounds[i] = prims.bounds(static_cast<uint32_t>(i));
+        });
+
+        switch (render_settings::global_settings.builder)
+        {
+            case bvh_build_method::sah_sweep: accel = bvh_builder::build(bounds); break;
+            case bvh_build_method::binned_sah: accel = binned_bvh_builder::build(bounds, pool); break;
+            case bvh_build_method::lbvh30: accel = lbvh_builder::build<uint32_t>(bounds, pool); break;
+            case bvh_build_method::lbvh63: accel = lbvh_builder::build<uint64_t>(bounds, pool); break;
+        }
+
+        prims.reorder(accel);
+
+        accel4 = {};
+        accel8 = {};
+        if (render_settings::global_settings.traversal == traversal_backend::bvh4)
+            accel4 = wide_bvh_builder::collapse<4>(accel, &wide_lanes);
+        if (render_settings::global_settings.traversal == traversal_backend::bvh8)
+            accel8 = wide_bvh_builder::collapse<8>(accel, &wide_lanes);
+
+        // a fresh build covers every pending change
+        for (const uint32_t i : changed_objects) object_changed[i] = 0;
+        changed_objects.clear();
+        refit_data = {};
+
+        build_instances(pool);
+        build_lights();
+
+        // report the whole build, including bounds and the wide collapse
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        accel.stats.build_ms = elapsed.count();
+        return accel.stats;
+    }
+
+    [[nodiscard]] const bvh& acceleration() const
+    {
+        return accel;
     }
 
     [[nodiscard]] size_t object_count() const
     {
-        return objects.size();
+        return prims.size();
     }
 
-    [[nodiscard]] object* unsafe_get_all_objects()
+    [[nodiscard]] size_t instance_count() const
     {
-        return objects.data();
+        return instances.size();
     }
 
-    [[nodiscard]] std::span<object> get_all_objects()
+    [[nodiscard]] size_t prototype_count() const
     {
-        return {objects};
+        return prototypes.size();
     }
 
+    [[nodiscard]] const light_list& light_emitters() const
+    {
+        return lights;
+    }
+
+    [[nodiscard]] const primitive_store& primitives() const
+    {
+        return prims;
+    }
+
+    // what the scene currently holds, as built by the last build_acceleration
+    [[nodiscard]] scene_memory memory() const
+    {
+        const auto bvh_bytes = [](const auto& b)
+        {
+            return b.nodes.size() * sizeof(b.nodes[0]) + b.prim_indices.size() * sizeof(uint32_t);
+        };
+
+        scene_memory m;
+        m.geometry = prims.geometry_bytes();
+        m.mesh_attributes = prims.attribute_bytes();
+        m.material_ids = prims.material_ids.size() * sizeof(material_id);
+        m.materials = materials.memory_bytes();
+        m.acceleration = bvh_bytes(accel) + bvh_bytes(accel4) + bvh_bytes(accel8) + wide_lanes.size() * sizeof(uint32_t);
+        m.instancing = instances.size() * sizeof(instance) + bvh_bytes(tlas);
+        for (const prototype& p : prototypes) m.instancing += p.prims.memory_bytes() + bvh_bytes(p.blas);
+        m.lights = lights.memory_bytes() + light_tree.memory_bytes() +
+                   emitter_of.size() * (sizeof(uint64_t) + sizeof(uint32_t));
+        return m;
+    }
+
+    // Material at the closest hit along r, or nullptr when nothing is hit, with the surface there in is.
+    // The search and the surface step are find_closest_hit and surface_interaction below.
+    const material* closest_hit(const ray& r, intersection& is, traversal_stats* stats = nullptr) const
+    {
+        return surface_interaction(r, find_closest_hit(r, stats), is);
+    }
+
+    // The closest hit along r as distance, primitive (and instance) and barycentrics, nothing more.
+    // Objects are found through whichever structure render_settings::traversal selects (falling back
+    // to the binary BVH and then to every object when it was not built), instances through the
+    // top-level BVH and their prototype's BVH.
+    [[nodiscard]] hit_record find_closest_hit(const ray& r, traversal_stats* stats = nullptr) const
+    {
+        hit_record closest;
+
+        // closest.t is the t_max the traversal prunes with, the tests shrink it in place
+        const auto test_scene_objects = [&](const uint32_t* leaf, const uint32_t count, float&)
+        {
+            intersect_closer(prims, leaf, count, r, closest);
+        };
+
+        const traversal_backend backend = render_settings::global_settings.traversal;
+        if (backend == traversal_backend::bvh8 && !accel8.empty())
+            traverse_wide_bvh(accel8, r, closest.t, test_scene_objects, stats);
+        else if (backend == traversal_backend::bvh4 && !accel4.empty())
+            traverse_wide_bvh(accel4, r, closest.t, test_scene_objects, stats);
+        else if (!accel.empty())
+            traverse_bvh(accel, r, closest.t, test_scene_objects, stats);
+        else
+        {
+            // no BVH: every object, 8 ids at a time so added triangles still share the wide test
+            uint32_t ids[8];
+            for (uint32_t first = 0; first < prims.size(); first += 8)
+            {
+                const auto n = static_cast<uint32_t>(std::min<size_t>(prims.size() - first, 8));
+                for (uint32_t i = 0; i < n; i++) ids[i] = first + i;
+                test_scene_objects(ids, n, closest.t);
+            }
+        }
+
+        closest_instance_hit(r, closest, stats);
+        return closest;
+    }
+
+    // The one surface step for a hit from find_closest_hit: position, shading normal, uv and the
+    // material, which is returned (nullptr when h is no hit).
+    const material* surface_interaction(const ray& r, const hit_record& h, intersection& is) const
+    {
+        if (!h.found()) return nullptr;
+        if (h.instance == hit_record::NONE)
+        {
+            ::surface_interaction(prims, h, r, is);
+            return &materials[hit_material(h)];
+        }
+
+        // worked out in object space along the ray the hit was found with, then brought back
+        const instance& inst = instances[h.instance];
+        const prototype& proto = prototypes[inst.prototype_index];
+        ::surface_interaction(proto.prims, h, inst.object_ray(r), is);
+        is.position = r.at(h.t);
+        is.normal = inst.to_object.transposed_vector(is.normal).normalized();
+        return &materials[hit_material(h)];
+    }
+
+    // Material id of a hit from find_closest_hit, e.g. for sorting hits before shading them.
+    [[nodiscard]] material_id hit_material(const hit_record& h) const
+    {
+        if (h.instance == hit_record::NONE) return prims.material_of(h.prim);
+        const instance& inst = instances[h.instance];
+        return inst.material_override ? *inst.material_override
+                                      : prototypes[inst.prototype_index].prims.material_of(h.prim);
+    }
+
+    // closest_hit for up to N rays at once (N = 8 or 16), results in is[i] and hit_mats[i]. The flat
+    // objects are found by one packet traversal of the binary BVH with SIMD primitive tests, which
+    // leaves each ray's hit in the packet for the surface step. Packets whose directions diverge go
+    // through closest_hit one ray at a time, and instances are always traced per ray.
+    template <int N>
+    void closest_hit_packet(const ray* rays, const int count, intersection* is, const material** hit_mats,
+                            traversal_stats* stats = nullptr) const
+    {
+        ray_packet<N> p(rays, count);
+        if (accel.empty() || !p.coherent())
+        {
+            for (int i = 0; i < count; i++) hit_mats[i] = closest_hit(rays[i], is[i], stats);
+            return;
+        }
+
+        traverse_bvh_packet(accel, p, [&](const uint32_t prim, const uint32_t lanes)
+        {
+            intersect_packet(p, prims, lanes, prim);
+        }, stats);
+
+        for (int i = 0; i < count; i++)
+        {
+            hit_record h;
+            if (p.prim[i] != ray_packet<N>::NO_PRIM)
+            {
+                h.t = p.t_max[i];
+                h.prim = p.prim[i];
+                h.u = p.u[i];
+                h.v = p.v[i];
+            }
+            closest_instance_hit(rays[i], h, stats);
+            hit_mats[i] = surface_interaction(rays[i], h, is[i]);
+        }
+    }
+
+    // True when anything blocks r before t_max, for shadow and other visibility rays. Stops at the
+    // first blocker found, skips the normal work of closest_hit and never orders children by distance.
+    [[nodiscard]] bool occluded(const ray& r, const float t_max, traversal_stats* stats = nullptr) const
+    {
+        const auto blocks_scene_object = [&](const uint32_t* leaf, const uint32_t count)
+        {
+            return occludes(prims, leaf, count, r, t_max);
+        };
+
+        bool hit = false;
+        const traversal_backend backend = render_settings::global_settings.traversal;
+        if (backend == traversal_backend::bvh8 && !accel8.empty())
+            hit = occluded_wide_bvh(accel8, r, t_max, blocks_scene_object, stats);
+        else if (backend == traversal_backend::bvh4 && !accel4.empty())
+            hit = occluded_wide_bvh(accel4, r, t_max, blocks_scene_object, stats);
+        else if (!accel.empty())
+            hit = occluded_bvh(accel, r, t_max, blocks_scene_object, stats);
+        else
+            for (uint32_t i = 0; i < prims.size() && !hit; i++) hit = occludes(prims, i, r, t_max);
+        if (hit) return true;
+
+        // same unnormalised object space rays as closest_hit, so t_max needs no conversion
+        return occluded_bvh(tlas, r, t_max, [&](const uint32_t instance_index)
+        {
+            const instance& inst = instances[instance_index];
+            const prototype& proto = prototypes[inst.prototype_index];
+            const ray local_ray = inst.object_ray(r);
+
+            return occluded_bvh(proto.blas, local_ray, t_max, [&](const uint32_t* leaf, const uint32_t count)
+            {
+                return occludes(proto.prims, leaf, count, local_ray, t_max);
+            }, stats);
+        }, stats);
+    }
+
+    // radiance arriving along r, for a path that has already bounced depth times
     color trace_ray(const ray& r, const int depth)
     {
-        constexpr float EPSILON = 1e-6f;
         if(depth > render_settings::global_settings.max_bounces) return {.0f,.0f,.0f};
 
-        float closest_t = 1e30f;
-        const object* hit_obj = nullptr;
-        vector3 hit_pos, hit_normal;
         intersection is;
+        const material* hit_mat = closest_hit(r, is);
+        return shade(r, is, hit_mat, depth);
+    }
 
-        for (const auto& obj : objects)
-        {
-            std::visit([&](auto const& shape) {
-                if (intersection i; intersect(r, shape, i) && i.intersection_distance < closest_t)
-                {
-                    closest_t = i.intersection_distance;
-                    hit_obj = &obj;
-                    hit_pos = r.at(i.intersection_distance);
-                    hit_normal = i.normal;
-                    is = i;
-                }
-            }, obj.shape);
-        }
+    // trace_ray for up to N primary rays (depth 0), sharing one packet traversal for the first hits
+    template <int N>
+    void trace_packet(const ray* rays, const int count, color* out)
+    {
+        intersection is[N];
+        const material* hit_mats[N];
+        closest_hit_packet<N>(rays, count, is, hit_mats);
+        for (int i = 0; i < count; i++) out[i] = shade(rays[i], is[i], hit_mats[i], 0);
+    }
 
-        if(!hit_obj)
+    // Radiance leaving the hit of r towards its origin, following the path from there one scatter per
+    // hit. Shadow rays are traced as soon as a hit asks for one; wavefront_renderer batches them.
+    // direct_resampled says the caller estimates the direct light at the first hit itself, as
+    // restir_renderer does for diffuse ones: it is not sampled there, and the emission the bounce
+    // from there finds is left out as it would be without MIS.
+    color shade(ray r, intersection is, const material* hit_mat, int depth, const bool direct_resampled = false)
+    {
+        if(!hit_mat)
             return {.0f, .0f, .0f};
 
+        color debug_view;
+        if (debug_color(is, *hit_mat, debug_view))
+            return debug_view;
+
+        path_state path;
+        path.depth = depth;
+        path.resampled_depth = direct_resampled ? depth : -1;
+        hit_record hit; // of is, kept from the second hit on
+        while (hit_mat)
+        {
+            shadow_query shadow;
+            const bool goes_on = scatter(r, is, hit, *hit_mat, path, shadow);
+            if (shadow.pending && !occluded(shadow.r, shadow.t_max))
+                path.radiance += shadow.contribution;
+            if (!goes_on) break;
 
-        // debugs
+            hit = find_closest_hit(r);
+            hit_mat = surface_interaction(r, hit, is);
+        }
+        return path.radiance;
+    }
+
+    // The first hit's colour in the debug views, false when render_settings::debug is off.
+    bool debug_color(const intersection& is, const material& mat, color& out) const
+    {
         if (render_settings::global_settings.debug == debug::albedo)
-            return hit_obj->mat.albedo;
+        {
+            out = mat.albedo;
+            return true;
+        }
 
         if (render_settings::global_settings.debug == debug::normal)
-            return {hit_normal.x, hit_normal.y, hit_normal.z};
+        {
+            out = {is.normal.x, is.normal.y, is.normal.z};
+            return true;
+        }
 
         if (render_settings::global_settings.debug == debug::depth)
         {
-            float depth_linear = (closest_t / 1024.0f);
+            float depth_linear = (is.intersection_distance / 1024.0f);
             float depth_non_linear = std::sqrt(depth_linear);
-            return (color){depth_non_linear};
+            out = (color){depth_non_linear};
+            return true;
         }
+        return false;
+    }
 
+    // One hit of a path, at is along r (h its record): adds its emission times the throughput of the
+    // bounces before it, then picks the bounce, scales the throughput by the albedo and turns r into the
+    // bounced ray. With next_event_estimation a diffuse hit also samples the emitters, handing back the
+    // shadow ray in shadow; that sample and the emission the bounce finds next are weighted against each
+    // other by the power heuristic, or the bounce's is left out without MIS. False when the path ends.
+    bool scatter(ray& r, const intersection& is, const hit_record& h, const material& mat, path_state& path,
+                 shadow_query& shadow) const
+    {
+        const bool sample_lights = render_settings::global_settings.next_event_estimation && !lights.empty();
+        const vector3 hit_pos = r.at(is.intersection_distance);
+        const vector3 hit_normal = is.normal;
 
-        const material& mat = hit_obj->mat;
-        color emitted = mat.emission;
+        if (mat.emissive())
+        {
+            const bool after_resampled = path.resampled_depth >= 0 && path.depth == path.resampled_depth + 1;
+            path.radiance += path.throughput * mat.emission *
+                             emission_weight(r, is, h, path.bounce_pdf, path.bounce_normal, sample_lights, after_resampled);
+        }
         color f = mat.albedo;
         float refl = mat.reflectivity;
 
@@ -107,29 +579,246 @@ public:
             nl = -hit_normal;
 
         float p = std::max({f.r, f.g, f.b});
-        if(depth > 4 && randf() >= p) return emitted;
-        if(depth > 4) f = f * (1.0f / p);
+        if(path.depth > 4 && randf() >= p) return false;
+        if(path.depth > 4) f = f * (1.0f / p);
 
         if(std::max({f.r, f.g, f.b}) < 0.05f)
-            return emitted;
+            return false;
+
+        const bool diffuse = refl <= 0.0f || randf() >= refl;
+        const vector3 dir = diffuse ? random_cosine_hemisphere(nl)
+                                    : (r.direction - nl * 2.0f * vector3::dot(r.direction, nl)).normalized();
+
+        color light;
+        if (diffuse && sample_lights && path.depth != path.resampled_depth &&
+            sample_direct_light(hit_pos + nl*1e-4f, nl, shadow.r, shadow.t_max, light))
+        {
+            shadow.contribution = path.throughput * f * light;
+            shadow.pending = true;
+        }
+        path.bounce_pdf = diffuse ? cosine_hemisphere_pdf(nl, dir) : 0.0f;
+        path.bounce_normal = nl;
+
+        path.throughput = path.throughput * f;
+        if(++path.depth > render_settings::global_settings.max_bounces)
+            return false;
+
+        r = ray(hit_pos + nl*1e-4f, dir);
+        return true;
+    }
+
+    // Light from one point sampled on the emitters that reaches origin, divided by the density of the
+    // sample and weighted by the cosine at origin against n, or black when something blocks it.
+    // Times albedo / pi it estimates the diffuse reflection of direct light at origin; with
+    // multiple_importance_sampling it carries its power heuristic weight against the cosine bounce.
+    [[nodiscard]] color direct_light(const vector3& origin, const vector3& n) const
+    {
+        ray shadow;
+        float t_max;
+        color light;
+        if (!sample_direct_light(origin, n, shadow, t_max, light) || occluded(shadow, t_max)) return {};
+        return light;
+    }
+
+    // direct_light up to its shadow ray: the light it brings if nothing blocks shadow before t_max,
+    // false when it brings none anyway
+    bool sample_direct_light(const vector3& origin, const vector3& n, ray& shadow, float& t_max, color& light) const
+    {
+        light_sample ls;
+        if (!sample_light(origin, n, ls)) return false;
+
+        const vector3 to_light = ls.position - origin;
+        const float dist_2 = to_light.length_2();
+        const float dist = std::sqrt(dist_2);
+        const vector3 dir = to_light / dist;
 
-        if(refl <= 0.0f)
+        const float cos_surface = vector3::dot(n, dir);
+        const float cos_light = std::fabs(vector3::dot(ls.normal, dir)); // emitters light both sides
+        if (cos_surface <= 0.0f || cos_light <= 0.0f) return false;
+
+        // stop short of the sampled point, so the emitter itself does not count as a blocker
+        shadow = ray(origin, dir);
+        t_max = dist * (1.0f - SHADOW_RAY_SHORTEN);
+
+        float weight = 1.0f;
+        if (render_settings::global_settings.multiple_importance_sampling)
+            weight = power_heuristic(light_pdf(ls.pdf_area, dist_2, cos_light), cosine_hemisphere_pdf(n, dir));
+        light = ls.emission * (weight * cos_surface * cos_light / (static_cast<float>(M_PI) * dist_2 * ls.pdf_area));
+        return true;
+    }
+
+    // A point on an emitter for a surface at p with normal n, picked the way direct_light picks it,
+    // with the density it was picked with; false where no emitter can reach p.
+    bool sample_light(const vector3& p, const vector3& n, light_sample& ls) const
+    {
+        uint32_t e;
+        float pmf;
+        if (!pick_emitter(p, n, e, pmf)) return false;
+        ls = sample_emitter(lights.emitters[e], pmf);
+        return true;
+    }
+
+    // true when nothing blocks the way from origin to light_point, a point on an emitter
+    [[nodiscard]] bool light_visible(const vector3& origin, const vector3& light_point) const
+    {
+        const vector3 to_light = light_point - origin;
+        const float dist = to_light.length();
+        return dist > 0.0f && !occluded(ray(origin, to_light / dist), dist * (1.0f - SHADOW_RAY_SHORTEN));
+    }
+
+private:
+    // Share of an emission found along r (at the hit h) that counts, when the bounce that cast r had
+    // density bounce_pdf and direct_light also sampled the emitters from where it started, a surface
+    // with normal bounce_normal: the chance of direct_light picking this emitter from there, spread
+    // over its area, against the bounce. Light resampled by the caller has no such chance to weigh.
+    [[nodiscard]] float emission_weight(const ray& r, const intersection& is, const hit_record& h, const float bounce_pdf,
+                                        const vector3& bounce_normal, const bool sampled_lights,
+                                        const bool resampled) const
+    {
+        if (resampled) return 0.0f;
+        if (!sampled_lights || bounce_pdf <= 0.0f) return 1.0f;
+        if (!render_settings::global_settings.multiple_importance_sampling) return 0.0f;
+
+        const auto it = emitter_of.find(emitter_key(h.instance, h.prim));
+        if (it == emitter_of.end()) return 1.0f; // too small for the light list, only bounces find it
+
+        const float pdf_area = emitter_pmf(it->second, r.origin, bounce_normal) / lights.emitters[it->second].area;
+        const float dist = is.intersection_distance;
+        const float cos_light = std::fabs(vector3::dot(is.normal, r.direction));
+        return power_heuristic(bounce_pdf, light_pdf(pdf_area, dist * dist, cos_light));
+    }
+
+    // the emitter direct_light samples for a surface at p with normal n, by render_settings::light_picking
+    bool pick_emitter(const vector3& p, const vector3& n, uint32_t& e, float& pmf) const
+    {
+        if (lights.empty()) return false;
+        if (render_settings::global_settings.light_picking == light_selection::by_importance)
+            return pick_light(light_tree, p, n, randf(), e, pmf);
+        e = lights.pick(randf());
+        pmf = lights.pmf(e);
+        return true;
+    }
+
+    // probability of pick_emitter returning e for p and n
+    [[nodiscard]] float emitter_pmf(const uint32_t e, const vector3& p, const vector3& n) const
+    {
+        if (render_settings::global_settings.light_picking == light_selection::by_importance)
+            return light_pmf(light_tree, p, n, e);
+        return lights.pmf(e);
+    }
+
+    static uint64_t emitter_key(const uint32_t instance, const uint32_t prim)
+    {
+        return static_cast<uint64_t>(instance) << 32 | prim;
+    }
+
+    static constexpr float SHADOW_RAY_SHORTEN = 1e-3f; // fraction of a shadow ray left out at the light's end
+
+    // gathers every primitive with an emissive material into lights, instanced ones moved to world
+    // space, and builds the light BVH over them; primitive ids must be final, after any reorder
+    void build_lights()
+    {
+        lights.clear();
+        emitter_of.clear();
+        for (uint32_t prim = 0; prim < prims.size(); prim++)
         {
-            vector3 dir = random_cosine_hemisphere(nl);
-            ray new_ray(hit_pos + nl*1e-4f, dir);
-            return emitted + f * trace_ray(new_ray, depth+1);
+            const material& m = materials[prims.material_of(prim)];
+            if (m.emissive() && lights.add(prims.shape(prim), m.emission))
+                emitter_of[emitter_key(hit_record::NONE, prim)] = static_cast<uint32_t>(lights.size() - 1);
         }
-        if(randf() < refl)
+        for (uint32_t i = 0; i < instances.size(); i++)
         {
-            vector3 refl_dir = r.direction - nl * 2.0f * vector3::dot(r.direction, nl);
-            ray refl_ray(hit_pos + nl*1e-4f, refl_dir.normalized());
-            return emitted + f * trace_ray(refl_ray, depth+1);
+            const instance& inst = instances[i];
+            const primitive_store& proto_prims = prototypes[inst.prototype_index].prims;
+            for (uint32_t prim = 0; prim < proto_prims.size(); prim++)
+            {
+                const material& m = materials[inst.material_override ? *inst.material_override : proto_prims.material_of(prim)];
+                if (!m.emissive()) continue;
+                // a sphere under a non-uniform scale is an ellipsoid, which the light list can't sample;
+                // left out, only bounces find it (emission_weight gives those their full weight)
+                if (std::holds_alternative<sphere>(proto_prims.shape(prim)) && !inst.to_world.is_similarity()) continue;
+                const bool added = lights.add(std::visit([&](const auto& shape) -> std::variant<triangle, sphere>
+                {
+                    return shape.transformed(inst.to_world);
+                }, proto_prims.shape(prim)), m.emission);
+                if (added) emitter_of[emitter_key(i, prim)] = static_cast<uint32_t>(lights.size() - 1);
+            }
         }
+
+        std::vector<light_bounds> bounds;
+        bounds.reserve(lights.size());
+        for (const emitter& e : lights.emitters) bounds.push_back(e.bounds());
+        light_tree = light_bvh_builder::build(bounds);
+    }
+
+    // closest hit search over the instances, with the ray moved into object space; the direction is left
+    // unnormalised so distances along it stay world space distances and closest.t carries over unchanged
+    void closest_instance_hit(const ray& r, hit_record& closest, traversal_stats* stats) const
+    {
+        traverse_bvh(tlas, r, closest.t, [&](const uint32_t instance_index, float&)
         {
-            vector3 dir = random_cosine_hemisphere(nl);
-            ray diffuse_ray(hit_pos + nl*1e-4f, dir);
-            return emitted + f * trace_ray(diffuse_ray, depth+1);
+            const instance& inst = instances[instance_index];
+            const prototype& proto = prototypes[inst.prototype_index];
+            const ray local_ray = inst.object_ray(r);
+
+            traverse_bvh(proto.blas, local_ray, closest.t, [&](const uint32_t* leaf, const uint32_t count, float&)
+            {
+                if (intersect_closer(proto.prims, leaf, count, local_ray, closest)) closest.instance = instance_index;
+            }, stats);
+        }, stats);
+    }
+
+    // builds missing prototype BVHs (always binned SAH, prototypes are small) and the top-level BVH over instance world bounds
+    void build_instances(thread_pool* pool)
+    {
+        for (auto& proto : prototypes)
+        {
+            if (!proto.blas.empty()) continue;
+            std::vector<aabb> bounds;
+            bounds.reserve(proto.prims.size());
+            for (uint32_t i = 0; i < proto.prims.size(); i++) bounds.push_back(proto.prims.bounds(i));
+            proto.blas = binned_bvh_builder::build(bounds, pool);
+            proto.prims.reorder(proto.blas);
         }
+
+        std::vector<aabb> bounds(instances.size());
+        parallel_for(pool, 0, instances.size(), binned_bvh_builder::PARALLEL_GRAIN, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; i++) bounds[i] = instance_bounds(i);
+        });
+        tlas = binned_bvh_builder::build(bounds, pool);
+        tlas_refit_data = {};
+        changed_instances.clear();
+    }
+
+    // refits the top-level BVH over moved instances, rebuilding it when it degrades too far
+    void refit_instances(thread_pool* pool)
+    {
+        if (tlas.empty() && !instances.empty())
+        {
+            build_instances(pool);
+            return;
+        }
+        if (changed_instances.empty()) return;
+
+        if (tlas_refit_data.empty()) tlas_refit_data = bvh_refitter::prepare(tlas);
+        const bvh_refit_stats stats = bvh_refitter::refit(tlas, tlas_refit_data, changed_instances,
+                                                          [&](const uint32_t i) { return instance_bounds(i); }, pool);
+        changed_instances.clear();
+        if (stats.cost_ratio > render_settings::global_settings.bvh_rebuild_ratio) build_instances(pool);
+    }
+
+    [[nodiscard]] aabb instance_bounds(const size_t index) const
+    {
+        const instance& inst = instances[index];
+        return inst.world_bounds(prototypes[inst.prototype_index].bounds);
+    }
+
+    void mark_changed(const size_t index)
+    {
+        if (object_changed[index]) return;
+        object_changed[index] = 1;
+        changed_objects.push_back(static_cast<uint32_t>(index));
     }
 };
 
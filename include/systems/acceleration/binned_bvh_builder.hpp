@@ -0,0 +1,406 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - binned_bvh_builder.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_BINNED_BVH_BUILDER
+#define RAY_TRACER_BINNED_BVH_BUILDER
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/math/aabb.hpp"
+#include "systems/acceleration/bvh_builder.hpp"
+#include "systems/threading/thread_pool.hpp"
+
+// Binned SAH builder. Large ranges at the top of the tree are binned and
+// partitioned by all pool threads, and their two halves are built as separate
+// tasks; once a range is small enough one task builds the whole subtree.
+// The subtrees are stitched into the usual depth-first node array at the end.
+struct binned_bvh_builder
+{
+    static constexpr int BIN_COUNT = 16;
+    static constexpr uint32_t SUBTREE_SIZE = 4096;  // ranges up to this size are built by a single task
+    static constexpr size_t PARALLEL_GRAIN = 16384; // primitives per chunk for parallel binning and partitioning
+
+    static bvh build(const std::span<const aabb> prim_bounds, thread_pool* pool = nullptr)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        bvh result;
+        if (prim_bounds.empty()) return result;
+
+        const size_t n = prim_bounds.size();
+        build_context ctx{prim_bounds, std::vector<vector3>(n), {}, pool};
+        if (pool) ctx.scratch.resize(n);
+
+        result.prim_indices.resize(n);
+        parallel_for(pool, 0, n, PARALLEL_GRAIN, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                ctx.centroids[i] = prim_bounds[i].centroid();
+                result.prim_indices[i] = static_cast<uint32_t>(i);
+            }
+        });
+
+        const range_bounds root_bounds = compute_bounds(ctx, result.prim_indices, 0, static_cast<uint32_t>(n));
+        const std::unique_ptr<top_node> root = build_top(ctx, result.prim_indices, 0, static_cast<uint32_t>(n), root_bounds, 0);
+
+        result.nodes.reserve(2 * n);
+        flatten(*root, result);
+        result.stats.node_count = result.nodes.size();
+        result.stats.sah_cost = bvh_builder::sah_cost(result);
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        result.stats.build_ms = elapsed.count();
+        return result;
+    }
+
+private:
+    struct build_context
+    {
+        std::span<const aabb> bounds;
+        std::vector<vector3> centroids;
+        std::vector<uint32_t> scratch; // partition target for the parallel levels
+        thread_pool* pool;
+    };
+
+    struct range_bounds
+    {
+        aabb bounds;
+        aabb centroid_bounds;
+
+        void expand(const range_bounds& o) { bounds.expand(o.bounds); centroid_bounds.expand(o.centroid_bounds); }
+    };
+
+    struct bin
+    {
+        range_bounds b;
+        uint32_t count{0};
+    };
+
+    using bin_set = std::array<std::array<bin, BIN_COUNT>, 3>;
+
+    struct split
+    {
+        int axis{-1};
+        int bin{0}; // last bin on the left side
+        float cost{FLT_MAX};
+        range_bounds left, right;
+    };
+
+    // a subtree built by one task, interior offsets relative to its own first node
+    struct fragment
+    {
+        std::vector<bvh_node> nodes;
+        size_t leaf_count{0};
+        int max_depth{0};
+    };
+
+    // node of the parallel top part of the tree, either interior or a whole fragment
+    struct top_node
+    {
+        aabb bounds;
+        uint8_t axis{0};
+        std::unique_ptr<top_node> left, right;
+        fragment frag;
+    };
+
+    // ---------------------- Split Search ----------------------
+
+    static int bin_index(const aabb& centroid_bounds, const int axis, const float c)
+    {
+        const float lo = centroid_bounds.min[axis];
+        const float extent = centroid_bounds.max[axis] - lo;
+        const float b = (c - lo) * (static_cast<float>(BIN_COUNT) / extent);
+        if (!(b > 0.0f)) return 0; // also catches NaN from very thin ranges
+        return b >= static_cast<float>(BIN_COUNT - 1) ? BIN_COUNT - 1 : static_cast<int>(b);
+    }
+
+    static void bin_range(const build_context& ctx, const std::vector<uint32_t>& indices, const size_t begin,
+                          const size_t end, const aabb& centroid_bounds, bin_set& bins)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (centroid_bounds.max[axis] <= centroid_bounds.min[axis]) continue;
+            for (size_t i = begin; i < end; i++)
+            {
+                const uint32_t prim = indices[i];
+                bin& b = bins[axis][bin_index(centroid_bounds, axis, ctx.centroids[prim][axis])];
+                b.b.bounds.expand(ctx.bounds[prim]);
+                b.b.centroid_bounds.expand(ctx.centroids[prim]);
+                b.count++;
+            }
+        }
+    }
+
+    static split find_split(const bin_set& bins, const aabb& centroid_bounds, const float node_area)
+    {
+        split best;
+        const float inv_area = 1.0f / std::max(node_area, FLT_MIN);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (centroid_bounds.max[axis] <= centroid_bounds.min[axis]) continue;
+
+            // right hand side of every bin boundary, swept from the far end
+            std::array<range_bounds, BIN_COUNT> right_bounds;
+            std::array<uint32_t, BIN_COUNT> right_counts{};
+            range_bounds right;
+            uint32_t right_count = 0;
+            for (int i = BIN_COUNT - 1; i > 0; i--)
+            {
+                right.expand(bins[axis][i].b);
+                right_count += bins[axis][i].count;
+                right_bounds[i] = right;
+                right_counts[i] = right_count;
+            }
+
+            range_bounds left;
+            uint32_t left_count = 0;
+            for (int i = 0; i < BIN_COUNT - 1; i++)
+            {
+                left.expand(bins[axis][i].b);
+                left_count += bins[axis][i].count;
+                if (left_count == 0 || right_counts[i + 1] == 0) continue;
+
+                const float cost = bvh_builder::TRAVERSAL_COST + bvh_builder::INTERSECTION_COST * inv_area *
+                                   (left.bounds.surface_area() * static_cast<float>(left_count) +
+                                    right_bounds[i + 1].bounds.surface_area() * static_cast<float>(right_counts[i + 1]));
+                if (cost < best.cost)
+                {
+                    best.axis = axis;
+                    best.bin = i;
+                    best.cost = cost;
+                    best.left = left;
+                    best.right = right_bounds[i + 1];
+                }
+            }
+        }
+        return best;
+    }
+
+    static range_bounds compute_bounds(const build_context& ctx, const std::vector<uint32_t>& indices,
+                                       const uint32_t begin, const uint32_t end)
+    {
+        range_bounds result;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            result.bounds.expand(ctx.bounds[indices[i]]);
+            result.centroid_bounds.expand(ctx.centroids[indices[i]]);
+        }
+        return result;
+    }
+
+    // when binning finds nothing better than an oversized leaf (or all centroids coincide),
+    // split at the median of the widest centroid axis to keep the tree balanced
+    static uint32_t median_split(const build_context& ctx, std::vector<uint32_t>& indices, const uint32_t begin,
+                                 const uint32_t end, const aabb& centroid_bounds, split& s)
+    {
+        const int axis = centroid_bounds.longest_axis();
+        const uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+                         [&](const uint32_t a, const uint32_t b) { return ctx.centroids[a][axis] < ctx.centroids[b][axis]; });
+
+        s.axis = axis;
+        s.left = compute_bounds(ctx, indices, begin, mid);
+        s.right = compute_bounds(ctx, indices, mid, end);
+        return mid;
+    }
+
+    static bool near_depth_limit(const uint32_t count, const int depth)
+    {
+        return depth + bvh::median_depth(count, bvh_builder::MAX_LEAF_SIZE) >= bvh::MAX_DEPTH - 1;
+    }
+
+    // ---------------------- Serial Subtrees ----------------------
+
+    static void build_fragment(const build_context& ctx, std::vector<uint32_t>& indices, fragment& f,
+                               const uint32_t begin, const uint32_t end, const range_bounds& rb, const int depth)
+    {
+        const uint32_t node_index = static_cast<uint32_t>(f.nodes.size());
+        f.nodes.emplace_back();
+        f.nodes[node_index].bounds = rb.bounds;
+        f.max_depth = std::max(f.max_depth, depth);
+
+        const uint32_t count = end - begin;
+        const float leaf_cost = bvh_builder::INTERSECTION_COST * static_cast<float>(count);
+
+        // close to the depth limit only median splits still fit every leaf under it
+        split s;
+        if (count > 1 && !near_depth_limit(count, depth))
+        {
+            bin_set bins{};
+            bin_range(ctx, indices, begin, end, rb.centroid_bounds, bins);
+            s = find_split(bins, rb.centroid_bounds, rb.bounds.surface_area());
+        }
+
+        if (count <= bvh_builder::MAX_LEAF_SIZE && (s.axis < 0 || leaf_cost <= s.cost))
+        {
+            f.nodes[node_index].offset = begin;
+            f.nodes[node_index].prim_count = static_cast<uint16_t>(count);
+            f.leaf_count++;
+            return;
+        }
+
+        uint32_t mid;
+        if (s.axis < 0 || s.cost >= leaf_cost)
+            mid = median_split(ctx, indices, begin, end, rb.centroid_bounds, s);
+        else
+        {
+            const auto it = std::partition(indices.begin() + begin, indices.begin() + end, [&](const uint32_t prim)
+            {
+                return bin_index(rb.centroid_bounds, s.axis, ctx.centroids[prim][s.axis]) <= s.bin;
+            });
+            mid = static_cast<uint32_t>(it - indices.begin());
+        }
+
+        f.nodes[node_index].axis = static_cast<uint8_t>(s.axis);
+        build_fragment(ctx, indices, f, begin, mid, s.left, depth + 1);
+        f.nodes[node_index].offset = static_cast<uint32_t>(f.nodes.size()); // local index, rebased in flatten
+        build_fragment(ctx, indices, f, mid, end, s.right, depth + 1);
+    }
+
+    // ---------------------- Parallel Top Levels ----------------------
+
+    static std::unique_ptr<top_node> build_top(build_context& ctx, std::vector<uint32_t>& indices,
+                                               const uint32_t begin, const uint32_t end, const range_bounds& rb, const int depth)
+    {
+        auto node = std::make_unique<top_node>();
+        node->bounds = rb.bounds;
+
+        const uint32_t count = end - begin;
+        if (!ctx.pool || count <= SUBTREE_SIZE || depth >= bvh::MAX_DEPTH - 1)
+        {
+            build_fragment(ctx, indices, node->frag, begin, end, rb, depth);
+            return node;
+        }
+
+        // bin in parallel, one bin set per chunk, then reduce
+        const size_t chunk_count = (count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+        std::vector<bin_set> chunk_bins(chunk_count);
+        parallel_for(ctx.pool, 0, chunk_count, 1, [&](const size_t c0, const size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+            {
+                const size_t chunk_begin = begin + c * PARALLEL_GRAIN;
+                bin_range(ctx, indices, chunk_begin, std::min<size_t>(end, chunk_begin + PARALLEL_GRAIN),
+                          rb.centroid_bounds, chunk_bins[c]);
+            }
+        });
+
+        bin_set bins{};
+        for (const bin_set& cb : chunk_bins)
+            for (int axis = 0; axis < 3; axis++)
+                for (int i = 0; i < BIN_COUNT; i++)
+                {
+                    bins[axis][i].b.expand(cb[axis][i].b);
+                    bins[axis][i].count += cb[axis][i].count;
+                }
+
+        split s = find_split(bins, rb.centroid_bounds, rb.bounds.surface_area());
+        const float leaf_cost = bvh_builder::INTERSECTION_COST * static_cast<float>(count);
+
+        uint32_t mid;
+        if (s.axis < 0 || s.cost >= leaf_cost || near_depth_limit(count, depth))
+            mid = median_split(ctx, indices, begin, end, rb.centroid_bounds, s);
+        else
+            mid = parallel_partition(ctx, indices, begin, end, rb.centroid_bounds, s);
+
+        node->axis = static_cast<uint8_t>(s.axis);
+
+        task_group group(*ctx.pool);
+        group.run([&] { node->left = build_top(ctx, indices, begin, mid, s.left, depth + 1); });
+        node->right = build_top(ctx, indices, mid, end, s.right, depth + 1);
+        group.wait();
+        return node;
+    }
+
+    // stable two-pass partition: count the left side of every chunk, then scatter through scratch
+    static uint32_t parallel_partition(build_context& ctx, std::vector<uint32_t>& indices, const uint32_t begin,
+                                       const uint32_t end, const aabb& centroid_bounds, const split& s)
+    {
+        const auto goes_left = [&](const uint32_t prim)
+        {
+            return bin_index(centroid_bounds, s.axis, ctx.centroids[prim][s.axis]) <= s.bin;
+        };
+
+        const size_t chunk_count = (end - begin + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+        std::vector<uint32_t> left_counts(chunk_count, 0);
+        parallel_for(ctx.pool, 0, chunk_count, 1, [&](const size_t c0, const size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+            {
+                const size_t chunk_begin = begin + c * PARALLEL_GRAIN;
+                const size_t chunk_end = std::min<size_t>(end, chunk_begin + PARALLEL_GRAIN);
+                for (size_t i = chunk_begin; i < chunk_end; i++) left_counts[c] += goes_left(indices[i]);
+            }
+        });
+
+        const uint32_t total_left = std::accumulate(left_counts.begin(), left_counts.end(), 0u);
+        const uint32_t mid = begin + total_left;
+
+        parallel_for(ctx.pool, 0, chunk_count, 1, [&](const size_t c0, const size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+            {
+                const size_t chunk_begin = begin + c * PARALLEL_GRAIN;
+                const size_t chunk_end = std::min<size_t>(end, chunk_begin + PARALLEL_GRAIN);
+                const uint32_t left_before = std::accumulate(left_counts.begin(), left_counts.begin() + c, 0u);
+                const uint32_t right_before = static_cast<uint32_t>(chunk_begin - begin) - left_before;
+
+                uint32_t left_out = begin + left_before;
+                uint32_t right_out = mid + right_before;
+                for (size_t i = chunk_begin; i < chunk_end; i++)
+                {
+                    const uint32_t prim = indices[i];
+                    ctx.scratch[goes_left(prim) ? left_out++ : right_out++] = prim;
+                }
+            }
+        });
+
+        parallel_for(ctx.pool, begin, end, PARALLEL_GRAIN, [&](const size_t b, const size_t e)
+        {
+            std::copy(ctx.scratch.begin() + b, ctx.scratch.begin() + e, indices.begin() + b);
+        });
+        return mid;
+    }
+
+    // ---------------------- Stitching ----------------------
+
+    static void flatten(const top_node& t, bvh& out)
+    {
+        if (!t.frag.nodes.empty())
+        {
+            const auto base = static_cast<uint32_t>(out.nodes.size());
+            for (bvh_node node : t.frag.nodes)
+            {
+                if (!node.is_leaf()) node.offset += base;
+                out.nodes.push_back(node);
+            }
+            out.stats.leaf_count += t.frag.leaf_count;
+            out.stats.max_depth = std::max(out.stats.max_depth, t.frag.max_depth);
+            return;
+        }
+
+        const auto node_index = static_cast<uint32_t>(out.nodes.size());
+        out.nodes.emplace_back();
+        out.nodes[node_index].bounds = t.bounds;
+        out.nodes[node_index].axis = t.axis;
+        flatten(*t.left, out);
+        out.nodes[node_index].offset = static_cast<uint32_t>(out.nodes.size());
+        flatten(*t.right, out);
+    }
+};
+
+#endif // RAY_TRACER_BINNED_BVH_BUILDER
@@ -0,0 +1,177 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - bvh_builder.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_BVH_BUILDER
+#define RAY_TRACER_BVH_BUILDER
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/math/aabb.hpp"
+
+// Top-down builder using a full surface area heuristic sweep.
+// Works on primitive bounds only, so any primitive type can be put in it.
+struct bvh_builder
+{
+    static constexpr float TRAVERSAL_COST = 1.0f;
+    // per primitive; leaves are tested up to 8 at a time from the lanes (lane_intersection.hpp),
+    // which makes larger leaves of spheres or triangles worth it
+    static constexpr float INTERSECTION_COST = 0.25f;
+    static constexpr uint32_t MAX_LEAF_SIZE = 8;
+
+    static bvh build(const std::span<const aabb> prim_bounds)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        bvh result;
+        if (prim_bounds.empty()) return result;
+
+        build_context ctx{prim_bounds, {}, {}, result.stats};
+        ctx.centroids.reserve(prim_bounds.size());
+        for (const aabb& b : prim_bounds) ctx.centroids.push_back(b.centroid());
+
+        result.prim_indices.resize(prim_bounds.size());
+        std::iota(result.prim_indices.begin(), result.prim_indices.end(), 0u);
+        ctx.right_areas.resize(prim_bounds.size());
+
+        result.nodes.reserve(2 * prim_bounds.size());
+        build_node(ctx, result, 0, static_cast<uint32_t>(prim_bounds.size()), 0);
+        result.stats.sah_cost = sah_cost(result);
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        result.stats.build_ms = elapsed.count();
+        return result;
+    }
+
+    // expected cost of a random ray hitting the root
+    static float sah_cost(const bvh& b)
+    {
+        if (b.empty()) return 0.0f;
+        const float root_area = b.nodes[0].bounds.surface_area();
+        if (root_area <= 0.0f) return 0.0f;
+
+        float cost = 0.0f;
+        for (const bvh_node& node : b.nodes)
+        {
+            const float area = node.bounds.surface_area();
+            cost += node.is_leaf() ? area * INTERSECTION_COST * static_cast<float>(node.prim_count)
+                                   : area * TRAVERSAL_COST;
+        }
+        return cost / root_area;
+    }
+
+private:
+    struct build_context
+    {
+        std::span<const aabb> bounds;
+        std::vector<vector3> centroids;
+        std::vector<float> right_areas; // scratch for the sweep
+        bvh_build_stats& stats;
+    };
+
+    // appends the subtree over indices [begin,end) to b.nodes in depth-first order
+    static void build_node(build_context& ctx, bvh& b, const uint32_t begin, const uint32_t end, const int depth)
+    {
+        std::vector<uint32_t>& indices = b.prim_indices;
+        const uint32_t node_index = static_cast<uint32_t>(b.nodes.size());
+        b.nodes.emplace_back();
+
+        aabb bounds;
+        for (uint32_t i = begin; i < end; i++) bounds.expand(ctx.bounds[indices[i]]);
+        b.nodes[node_index].bounds = bounds;
+
+        ctx.stats.node_count++;
+        ctx.stats.max_depth = std::max(ctx.stats.max_depth, depth);
+
+        const uint32_t count = end - begin;
+        const float leaf_cost = INTERSECTION_COST * static_cast<float>(count);
+
+        int best_axis = -1;
+        uint32_t best_split = 0;
+        float best_cost = FLT_MAX;
+
+        // close to the depth limit only median splits still fit every leaf under it
+        const bool balance = depth + bvh::median_depth(count, MAX_LEAF_SIZE) >= bvh::MAX_DEPTH - 1;
+        if (count > 1 && !balance)
+        {
+            const float inv_area = 1.0f / std::max(bounds.surface_area(), FLT_MIN);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                sort_by_axis(ctx, indices, begin, end, axis);
+
+                // sweep right to left to get the area of every right hand side...
+                aabb right;
+                for (uint32_t i = end - 1; i > begin; i--)
+                {
+                    right.expand(ctx.bounds[indices[i]]);
+                    ctx.right_areas[i] = right.surface_area();
+                }
+
+                // ...then left to right to evaluate each split position
+                aabb left;
+                for (uint32_t i = begin + 1; i < end; i++)
+                {
+                    left.expand(ctx.bounds[indices[i - 1]]);
+                    const float left_count = static_cast<float>(i - begin);
+                    const float right_count = static_cast<float>(end - i);
+                    const float cost = TRAVERSAL_COST + INTERSECTION_COST * inv_area *
+                                       (left.surface_area() * left_count + ctx.right_areas[i] * right_count);
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = i;
+                    }
+                }
+            }
+        }
+
+        if (count <= MAX_LEAF_SIZE && (best_axis < 0 || leaf_cost <= best_cost))
+        {
+            b.nodes[node_index].offset = begin;
+            b.nodes[node_index].prim_count = static_cast<uint16_t>(count);
+            ctx.stats.leaf_count++;
+            return;
+        }
+
+        // no split beats a leaf but the leaf would be too big (e.g. many identical boxes), or the depth
+        // limit is near: take the median so the tree stays balanced instead of peeling off one
+        // primitive per level
+        if (best_axis < 0 || best_cost >= leaf_cost)
+        {
+            best_axis = bounds.longest_axis();
+            best_split = begin + count / 2;
+        }
+
+        // the last sweep was along z, bring the chosen axis back into order; no sweep ran when balancing
+        if (best_axis != 2 || balance) sort_by_axis(ctx, indices, begin, end, best_axis);
+
+        b.nodes[node_index].axis = static_cast<uint8_t>(best_axis);
+        build_node(ctx, b, begin, best_split, depth + 1);
+        b.nodes[node_index].offset = static_cast<uint32_t>(b.nodes.size());
+        build_node(ctx, b, best_split, end, depth + 1);
+    }
+
+    static void sort_by_axis(const build_context& ctx, std::vector<uint32_t>& indices,
+                             const uint32_t begin, const uint32_t end, const int axis)
+    {
+        // tie-break on the index so every sort of the same range gives the same order
+        std::sort(indices.begin() + begin, indices.begin() + end, [&](const uint32_t a, const uint32_t b)
+        {
+            const float ca = ctx.centroids[a][axis];
+            const float cb = ctx.centroids[b][axis];
+            return ca < cb || (ca == cb && a < b);
+        });
+    }
+};
+
+#endif // RAY_TRACER_BVH_BUILDER
@@ -0,0 +1,174 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - bvh_refitter.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_BVH_REFITTER
+#define RAY_TRACER_BVH_REFITTER
+
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+#include "systems/acceleration/bvh_builder.hpp"
+#include "systems/threading/thread_pool.hpp"
+
+// Bookkeeping that lets a built BVH be refitted after primitives move,
+// made once per build by bvh_refitter::prepare.
+struct bvh_refit_data
+{
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+    std::vector<uint32_t> parents;      // per node, NO_NODE for the root
+    std::vector<uint8_t> depths;        // per node
+    std::vector<uint32_t> leaf_of_prim; // primitive index -> leaf holding it
+    std::vector<uint32_t> marks;        // per node, == epoch once collected by the current refit
+    uint32_t epoch{0};
+
+    std::vector<std::vector<uint32_t>> levels; // nodes to refit per depth, reused between refits
+    std::vector<uint32_t> refitted;            // every node the last refit touched
+
+    double cost_sum{0};  // SAH cost times the root area, kept up to date incrementally
+    float built_cost{0}; // SAH cost right after the build, the reference for degradation
+
+    [[nodiscard]] bool empty() const { return parents.empty(); }
+};
+
+struct bvh_refit_stats
+{
+    size_t prims_changed{0};
+    size_t nodes_refitted{0};
+    double refit_ms{0};
+    float sah_cost{0};
+    float cost_ratio{1}; // sah_cost relative to the cost right after the last build
+    bool rebuilt{false};
+};
+
+// Bottom-up refit that only touches the changed leaves and their ancestors.
+// The touched nodes are refitted one depth at a time, deepest first, and
+// each depth is spread over the pool; the SAH cost is updated by the change in
+// area of the touched nodes so tracking it stays proportional to the change.
+struct bvh_refitter
+{
+    static bvh_refit_data prepare(const bvh& b)
+    {
+        bvh_refit_data d;
+        d.parents.assign(b.nodes.size(), bvh_refit_data::NO_NODE);
+        d.depths.assign(b.nodes.size(), 0);
+        d.marks.assign(b.nodes.size(), 0);
+        d.leaf_of_prim.assign(b.prim_indices.size(), bvh_refit_data::NO_NODE);
+
+        // parents always come before their children in the depth-first array
+        int max_depth = 0;
+        for (uint32_t i = 0; i < b.nodes.size(); i++)
+        {
+            const bvh_node& node = b.nodes[i];
+            max_depth = std::max<int>(max_depth, d.depths[i]);
+            d.cost_sum += weighted_area(node);
+
+            if (node.is_leaf())
+            {
+                for (uint32_t p = node.offset; p < node.offset + node.prim_count; p++)
+                    d.leaf_of_prim[b.prim_indices[p]] = i;
+                continue;
+            }
+
+            for (const uint32_t child : {i + 1, node.offset})
+            {
+                d.parents[child] = i;
+                d.depths[child] = static_cast<uint8_t>(d.depths[i] + 1);
+            }
+        }
+
+        d.levels.resize(max_depth + 1);
+        d.built_cost = bvh_builder::sah_cost(b);
+        return d;
+    }
+
+    // prim_bounds(prim_index) returns the current bounds of a primitive
+    template <typename BoundsFn>
+    static bvh_refit_stats refit(bvh& b, bvh_refit_data& d, const std::span<const uint32_t> changed_prims,
+                                 const BoundsFn& prim_bounds, thread_pool* pool = nullptr)
+    {
+        constexpr size_t GRAIN = 1024;
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        if (++d.epoch == 0)
+        {
+            std::fill(d.marks.begin(), d.marks.end(), 0);
+            d.epoch = 1;
+        }
+
+        // collect changed leaves and their ancestors, stopping at the first one already collected
+        for (auto& level : d.levels) level.clear();
+        for (const uint32_t prim : changed_prims)
+        {
+            for (uint32_t node = d.leaf_of_prim[prim]; node != bvh_refit_data::NO_NODE && d.marks[node] != d.epoch;
+                 node = d.parents[node])
+            {
+                d.marks[node] = d.epoch;
+                d.levels[d.depths[node]].push_back(node);
+            }
+        }
+
+        d.refitted.clear();
+        std::vector<double> deltas;
+        for (int depth = static_cast<int>(d.levels.size()) - 1; depth >= 0; depth--)
+        {
+            const std::vector<uint32_t>& level = d.levels[depth];
+            if (level.empty()) continue;
+
+            deltas.assign(level.size(), 0.0);
+            parallel_for(pool, 0, level.size(), GRAIN, [&](const size_t begin, const size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const uint32_t index = level[i];
+                    bvh_node& node = b.nodes[index];
+                    const double before = weighted_area(node);
+
+                    aabb bounds;
+                    if (node.is_leaf())
+                        for (uint32_t p = node.offset; p < node.offset + node.prim_count; p++)
+                            bounds.expand(prim_bounds(b.prim_indices[p]));
+                    else
+                        bounds = aabb::merge(b.nodes[index + 1].bounds, b.nodes[node.offset].bounds);
+
+                    node.bounds = bounds;
+                    deltas[i] = weighted_area(node) - before;
+                }
+            });
+
+            for (const double delta : deltas) d.cost_sum += delta;
+            d.refitted.insert(d.refitted.end(), level.begin(), level.end());
+        }
+
+        bvh_refit_stats stats;
+        stats.prims_changed = changed_prims.size();
+        stats.nodes_refitted = d.refitted.size();
+
+        const float root_area = b.nodes.empty() ? 0.0f : b.nodes[0].bounds.surface_area();
+        stats.sah_cost = root_area > 0.0f ? static_cast<float>(d.cost_sum / root_area) : 0.0f;
+        stats.cost_ratio = d.built_cost > 0.0f ? stats.sah_cost / d.built_cost : 1.0f;
+        b.stats.sah_cost = stats.sah_cost;
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        stats.refit_ms = elapsed.count();
+        return stats;
+    }
+
+private:
+    static double weighted_area(const bvh_node& node)
+    {
+        const double area = node.bounds.surface_area();
+        return node.is_leaf() ? area * bvh_builder::INTERSECTION_COST * node.prim_count
+                              : area * bvh_builder::TRAVERSAL_COST;
+    }
+};
+
+#endif // RAY_TRACER_BVH_REFITTER
@@ -0,0 +1,142 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - bvh_traversal.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_BVH_TRAVERSAL
+#define RAY_TRACER_BVH_TRAVERSAL
+
+#include <cstdint>
+#include <type_traits>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/acceleration/traversal_stats.hpp"
+#include "components/math/ray.hpp"
+#include "systems/math/intersection.hpp"
+
+// Hands the count primitives of a leaf to hit_prim: all at once when it takes
+// (const uint32_t* prims, count, t_max), so it can test them together, and
+// otherwise one hit_prim(prim_index, t_max) call per primitive.
+template <typename HitFn>
+inline void hit_leaf(HitFn& hit_prim, const uint32_t* prims, const uint32_t count, float& t_max)
+{
+    if constexpr (std::is_invocable_v<HitFn&, const uint32_t*, uint32_t, float&>)
+        hit_prim(prims, count, t_max);
+    else
+        for (uint32_t i = 0; i < count; i++) hit_prim(prims[i], t_max);
+}
+
+// Any hit counterpart of hit_leaf: the whole leaf to hit_prim(prims, count) when it takes that,
+// and otherwise hit_prim(prim_index) per primitive until one blocks the ray. True when one does.
+template <typename AnyHitFn>
+inline bool any_hit_leaf(AnyHitFn& hit_prim, const uint32_t* prims, const uint32_t count, traversal_stats* stats)
+{
+    if constexpr (std::is_invocable_r_v<bool, AnyHitFn&, const uint32_t*, uint32_t>)
+    {
+        if (stats) stats->prims_tested += count;
+        return hit_prim(prims, count);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (stats) stats->prims_tested++;
+            if (hit_prim(prims[i])) return true;
+        }
+        return false;
+    }
+}
+
+// Closest hit traversal. For every primitive in a leaf the ray reaches,
+// hit_prim(prim_index, t_max) is called (or once per leaf, see hit_leaf); it
+// should test the primitive and shrink t_max when it finds a closer hit,
+// which prunes the remaining nodes.
+template <typename HitFn>
+void traverse_bvh(const bvh& b, const ray& r, float& t_max, HitFn&& hit_prim, traversal_stats* stats = nullptr)
+{
+    if (b.empty()) return;
+    if (stats) stats->rays++;
+
+    const vector3 inv_dir(1.0f / r.direction.x, 1.0f / r.direction.y, 1.0f / r.direction.z);
+    const bool dir_is_neg[3] = {inv_dir.x < 0.0f, inv_dir.y < 0.0f, inv_dir.z < 0.0f};
+
+    uint32_t stack[bvh::MAX_DEPTH];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true)
+    {
+        const bvh_node& node = b.nodes[current];
+        if (stats) stats->nodes_visited++;
+
+        if (float t_near; intersect(r, inv_dir, node.bounds, t_max, t_near))
+        {
+            if (node.is_leaf())
+            {
+                if (stats) stats->prims_tested += node.prim_count;
+                hit_leaf(hit_prim, &b.prim_indices[node.offset], node.prim_count, t_max);
+            }
+            else
+            {
+                // visit the child on the near side of the split first, the far one waits on the stack
+                if (dir_is_neg[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+}
+
+// Any hit traversal for visibility queries. hit_prim(prim_index) returns
+// true when the primitive blocks the ray before t_max, which ends the
+// traversal (or once per leaf, see any_hit_leaf). No hit is closer than
+// another, so children are not ordered.
+template <typename AnyHitFn>
+bool occluded_bvh(const bvh& b, const ray& r, const float t_max, AnyHitFn&& hit_prim, traversal_stats* stats = nullptr)
+{
+    if (b.empty()) return false;
+    if (stats) stats->rays++;
+
+    const vector3 inv_dir(1.0f / r.direction.x, 1.0f / r.direction.y, 1.0f / r.direction.z);
+
+    uint32_t stack[bvh::MAX_DEPTH];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true)
+    {
+        const bvh_node& node = b.nodes[current];
+        if (stats) stats->nodes_visited++;
+
+        if (float t_near; intersect(r, inv_dir, node.bounds, t_max, t_near))
+        {
+            if (!node.is_leaf())
+            {
+                stack[stack_size++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+
+            if (any_hit_leaf(hit_prim, &b.prim_indices[node.offset], node.prim_count, stats)) return true;
+        }
+
+        if (stack_size == 0) return false;
+        current = stack[--stack_size];
+    }
+}
+
+#endif // RAY_TRACER_BVH_TRAVERSAL
@@ -0,0 +1,267 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - lbvh_builder.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_LBVH_BUILDER
+#define RAY_TRACER_LBVH_BUILDER
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/math/aabb.hpp"
+#include "systems/acceleration/bvh_builder.hpp"
+#include "systems/threading/radix_sort.hpp"
+#include "systems/threading/thread_pool.hpp"
+
+// Linear BVH: primitives are sorted along a Morton curve through their
+// centroids and the hierarchy falls out of the common prefixes of the sorted
+// codes (Karras 2012), so every step is O(n) and parallel except the final
+// depth-first emission. Much faster to build than SAH, somewhat slower to trace.
+// Key is uint32_t for 30-bit codes (10 bits per axis) or uint64_t for 63-bit (21 per axis).
+struct lbvh_builder
+{
+    static constexpr uint32_t LEAF_SIZE = 4; // subtrees this small become one leaf
+    static constexpr size_t PARALLEL_GRAIN = 16384;
+
+    template <typename Key>
+    static bvh build(const std::span<const aabb> prim_bounds, thread_pool* pool = nullptr)
+    {
+        static_assert(std::is_same_v<Key, uint32_t> || std::is_same_v<Key, uint64_t>);
+        const auto start = std::chrono::high_resolution_clock::now();
+
+        bvh result;
+        const size_t n = prim_bounds.size();
+        if (n == 0) return result;
+
+        // centroid bounds, reduced per chunk
+        const size_t chunk_count = (n + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN;
+        std::vector<aabb> chunk_bounds(chunk_count);
+        parallel_for(pool, 0, chunk_count, 1, [&](const size_t c0, const size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+                for (size_t i = c * PARALLEL_GRAIN; i < std::min(n, (c + 1) * PARALLEL_GRAIN); i++)
+                    chunk_bounds[c].expand(prim_bounds[i].centroid());
+        });
+        aabb centroid_bounds;
+        for (const aabb& b : chunk_bounds) centroid_bounds.expand(b);
+
+        std::vector<Key> codes(n);
+        result.prim_indices.resize(n);
+        const vector3 extent = centroid_bounds.extent();
+        const vector3 scale(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                            extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                            extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+        parallel_for(pool, 0, n, PARALLEL_GRAIN, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const vector3 c = prim_bounds[i].centroid() - centroid_bounds.min;
+                codes[i] = morton_code<Key>(c.x * scale.x, c.y * scale.y, c.z * scale.z);
+                result.prim_indices[i] = static_cast<uint32_t>(i);
+            }
+        });
+
+        parallel_radix_sort(pool, codes, result.prim_indices, CODE_BITS<Key>);
+
+        if (n == 1)
+        {
+            bvh_node& leaf = result.nodes.emplace_back();
+            leaf.bounds = prim_bounds[0];
+            leaf.prim_count = 1;
+            result.stats.node_count = result.stats.leaf_count = 1;
+        }
+        else
+        {
+            // internal node i of the radix tree, children with LEAF_BIT set are single primitives
+            std::vector<radix_node> radix(n - 1);
+            parallel_for(pool, 0, n - 1, PARALLEL_GRAIN, [&](const size_t begin, const size_t end)
+            {
+                for (size_t i = begin; i < end; i++) radix[i] = make_radix_node(codes, static_cast<int64_t>(i));
+            });
+
+            result.nodes.reserve(2 * n / LEAF_SIZE + 1);
+            emit(prim_bounds, radix, result, 0, 0);
+        }
+
+        result.stats.node_count = result.nodes.size();
+        result.stats.sah_cost = bvh_builder::sah_cost(result);
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        result.stats.build_ms = elapsed.count();
+        return result;
+    }
+
+private:
+    static constexpr uint32_t LEAF_BIT = 0x80000000u;
+
+    template <typename Key>
+    static constexpr int CODE_BITS = std::is_same_v<Key, uint32_t> ? 30 : 63;
+
+    struct radix_node
+    {
+        uint32_t left, right; // internal node index, or primitive position | LEAF_BIT
+        uint32_t first, last; // covered range of sorted primitives
+        uint8_t axis;         // axis of the highest differing code bit, left child is on its low side
+    };
+
+    // ---------------------- Morton Codes ----------------------
+
+    // spreads the low 10 bits of v so there are two zero bits between each
+    static uint32_t expand_bits(uint32_t v)
+    {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    // same for the low 21 bits of v
+    static uint64_t expand_bits(uint64_t v)
+    {
+        v &= 0x1FFFFFu;
+        v = (v | v << 32) & 0x001F00000000FFFFull;
+        v = (v | v << 16) & 0x001F0000FF0000FFull;
+        v = (v | v << 8)  & 0x100F00F00F00F00Full;
+        v = (v | v << 4)  & 0x10C30C30C30C30C3ull;
+        v = (v | v << 2)  & 0x1249249249249249ull;
+        return v;
+    }
+
+    // x, y, z are normalised to [0,1] inside the centroid bounds
+    template <typename Key>
+    static Key morton_code(const float x, const float y, const float z)
+    {
+        constexpr float cells = static_cast<float>(1u << (CODE_BITS<Key> / 3));
+        const auto quantize = [](const float f) { return static_cast<Key>(std::clamp(f * cells, 0.0f, cells - 1.0f)); };
+        return (expand_bits(quantize(x)) << 2) | (expand_bits(quantize(y)) << 1) | expand_bits(quantize(z));
+    }
+
+    // ---------------------- Radix Tree (Karras) ----------------------
+
+    // length of the common prefix of sorted codes i and j, -1 out of range;
+    // equal codes fall back to comparing the positions so duplicates still split
+    template <typename Key>
+    static int delta(const std::vector<Key>& codes, const int64_t i, const int64_t j)
+    {
+        if (j < 0 || j >= static_cast<int64_t>(codes.size())) return -1;
+        const Key a = codes[i], b = codes[j];
+        if (a == b) return static_cast<int>(sizeof(Key) * 8) + std::countl_zero(static_cast<uint64_t>(i ^ j));
+        return std::countl_zero(static_cast<Key>(a ^ b));
+    }
+
+    template <typename Key>
+    static radix_node make_radix_node(const std::vector<Key>& codes, const int64_t i)
+    {
+        // direction of the range from the neighbour sharing the longer prefix
+        const int64_t d = delta(codes, i, i + 1) - delta(codes, i, i - 1) >= 0 ? 1 : -1;
+        const int delta_min = delta(codes, i, i - d);
+
+        // upper bound for the range length, then binary search for the other end
+        int64_t l_max = 2;
+        while (delta(codes, i, i + l_max * d) > delta_min) l_max *= 2;
+
+        int64_t l = 0;
+        for (int64_t t = l_max / 2; t >= 1; t /= 2)
+            if (delta(codes, i, i + (l + t) * d) > delta_min) l += t;
+        const int64_t j = i + l * d;
+
+        // binary search for the split, the last position sharing the range's prefix
+        const int delta_node = delta(codes, i, j);
+        int64_t s = 0;
+        for (int64_t div = 2;; div *= 2)
+        {
+            const int64_t t = (l + div - 1) / div;
+            if (delta(codes, i, i + (s + t) * d) > delta_node) s += t;
+            if (t <= 1) break;
+        }
+        const int64_t gamma = i + s * d + std::min<int64_t>(d, 0);
+
+        radix_node node{};
+        const int split_bit = static_cast<int>(sizeof(Key) * 8) - 1 - delta_node;
+        node.axis = split_bit >= 0 ? static_cast<uint8_t>(2 - split_bit % 3) : 0; // x is the top bit of each triple
+        node.first = static_cast<uint32_t>(std::min(i, j));
+        node.last = static_cast<uint32_t>(std::max(i, j));
+        node.left = static_cast<uint32_t>(gamma) | (node.first == gamma ? LEAF_BIT : 0u);
+        node.right = static_cast<uint32_t>(gamma + 1) | (node.last == gamma + 1 ? LEAF_BIT : 0u);
+        return node;
+    }
+
+    // ---------------------- Depth-First Emission ----------------------
+
+    // writes the subtree under radix node ref in depth-first order and returns its bounds
+    static aabb emit(const std::span<const aabb> prim_bounds, const std::vector<radix_node>& radix,
+                     bvh& b, const uint32_t ref, const int depth)
+    {
+        uint32_t first, last;
+        if (ref & LEAF_BIT) first = last = ref & ~LEAF_BIT;
+        else { first = radix[ref].first; last = radix[ref].last; }
+
+        // close to the depth limit the radix tree may still go deeper than what is left, e.g. over
+        // a large cluster of equal codes; halving the range fits every leaf under the limit
+        const uint32_t count = last - first + 1;
+        if (count <= LEAF_SIZE || depth + bvh::median_depth(count, LEAF_SIZE) >= bvh::MAX_DEPTH - 1)
+            return emit_halves(prim_bounds, b, first, last, depth);
+
+        const uint32_t node_index = static_cast<uint32_t>(b.nodes.size());
+        b.nodes.emplace_back();
+        b.stats.max_depth = std::max(b.stats.max_depth, depth);
+
+        aabb bounds = emit(prim_bounds, radix, b, radix[ref].left, depth + 1);
+        b.nodes[node_index].offset = static_cast<uint32_t>(b.nodes.size());
+        bounds.expand(emit(prim_bounds, radix, b, radix[ref].right, depth + 1));
+
+        b.nodes[node_index].bounds = bounds;
+        b.nodes[node_index].axis = radix[ref].axis;
+        return bounds;
+    }
+
+    // the primitives first..last in Morton order as a leaf, or split at the middle of the range
+    // until they fit one; the split axis is the one the two halves lie furthest apart along
+    static aabb emit_halves(const std::span<const aabb> prim_bounds, bvh& b, const uint32_t first,
+                            const uint32_t last, const int depth)
+    {
+        const uint32_t node_index = static_cast<uint32_t>(b.nodes.size());
+        b.nodes.emplace_back();
+        b.stats.max_depth = std::max(b.stats.max_depth, depth);
+
+        const uint32_t count = last - first + 1;
+        if (count <= LEAF_SIZE)
+        {
+            aabb bounds;
+            for (uint32_t i = first; i <= last; i++) bounds.expand(prim_bounds[b.prim_indices[i]]);
+            b.nodes[node_index].bounds = bounds;
+            b.nodes[node_index].offset = first;
+            b.nodes[node_index].prim_count = static_cast<uint16_t>(count);
+            b.stats.leaf_count++;
+            return bounds;
+        }
+
+        const uint32_t mid = first + count / 2;
+        const aabb left = emit_halves(prim_bounds, b, first, mid - 1, depth + 1);
+        b.nodes[node_index].offset = static_cast<uint32_t>(b.nodes.size());
+        const aabb right = emit_halves(prim_bounds, b, mid, last, depth + 1);
+
+        const vector3 apart = right.centroid() - left.centroid();
+        const float spread[3] = {std::fabs(apart.x), std::fabs(apart.y), std::fabs(apart.z)};
+        b.nodes[node_index].axis = static_cast<uint8_t>(std::max_element(spread, spread + 3) - spread);
+
+        aabb bounds = left;
+        bounds.expand(right);
+        b.nodes[node_index].bounds = bounds;
+        return bounds;
+    }
+};
+
+#endif // RAY_TRACER_LBVH_BUILDER
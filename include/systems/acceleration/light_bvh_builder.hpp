@@ -0,0 +1,177 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - light_bvh_builder.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_LIGHT_BVH_BUILDER
+#define RAY_TRACER_LIGHT_BVH_BUILDER
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "components/acceleration/light_bvh.hpp"
+#include "components/math/aabb.hpp"
+
+// Builds a light_bvh with one emitter per leaf. Splits are binned like binned_bvh_builder's, but
+// cost the surface area times the power times the solid angle the normals spread over (SAOH), so
+// bright emitters and emitters facing different ways end up in different subtrees.
+struct light_bvh_builder
+{
+    static constexpr int BIN_COUNT = 12;
+
+    // emitters[i] describes emitter i, the index the leaves and trails refer to
+    static light_bvh build(const std::vector<light_bounds>& emitters)
+    {
+        light_bvh result;
+        if (emitters.empty()) return result;
+
+        std::vector<uint32_t> indices(emitters.size());
+        std::iota(indices.begin(), indices.end(), 0u);
+        result.nodes.reserve(2 * emitters.size());
+        result.trails.resize(emitters.size());
+        build_range(emitters, indices, 0, static_cast<uint32_t>(indices.size()), 0, 0, result);
+        return result;
+    }
+
+private:
+    struct bin
+    {
+        light_bounds b;
+        uint32_t count{0};
+    };
+
+    static void build_range(const std::vector<light_bounds>& emitters, std::vector<uint32_t>& indices,
+                            const uint32_t begin, const uint32_t end, const uint64_t trail, const int depth,
+                            light_bvh& out)
+    {
+        const auto node = static_cast<uint32_t>(out.nodes.size());
+        out.nodes.emplace_back();
+
+        if (end - begin == 1)
+        {
+            const uint32_t e = indices[begin];
+            out.nodes[node] = {emitters[e], e, true};
+            out.trails[e] = trail;
+            return;
+        }
+
+        light_bounds total;
+        aabb centroid_bounds;
+        for (uint32_t i = begin; i < end; i++)
+        {
+            total = light_bounds::merge(total, emitters[indices[i]]);
+            centroid_bounds.expand(emitters[indices[i]].bounds.centroid());
+        }
+
+        const uint32_t mid = split(emitters, indices, begin, end, total, centroid_bounds, depth);
+        build_range(emitters, indices, begin, mid, trail, depth + 1, out);
+        out.nodes[node].offset = static_cast<uint32_t>(out.nodes.size());
+        build_range(emitters, indices, mid, end, trail | (uint64_t{1} << depth), depth + 1, out);
+        out.nodes[node].b = total;
+    }
+
+    // returns the first index of the second half; past half the trail bits it halves by count,
+    // which bounds the depth by MAX_DEPTH for any number of emitters a uint32_t can index
+    static uint32_t split(const std::vector<light_bounds>& emitters, std::vector<uint32_t>& indices,
+                          const uint32_t begin, const uint32_t end, const light_bounds& total,
+                          const aabb& centroid_bounds, const int depth)
+    {
+        int best_axis = -1, best_bin = 0;
+        float best_cost = FLT_MAX;
+        for (int axis = 0; axis < 3 && depth < light_bvh::MAX_DEPTH / 2; axis++)
+        {
+            if (centroid_bounds.max[axis] <= centroid_bounds.min[axis]) continue;
+
+            std::array<bin, BIN_COUNT> bins{};
+            for (uint32_t i = begin; i < end; i++)
+            {
+                const light_bounds& e = emitters[indices[i]];
+                bin& b = bins[bin_index(centroid_bounds, axis, e.bounds.centroid()[axis])];
+                b.b = light_bounds::merge(b.b, e);
+                b.count++;
+            }
+
+            // cost of everything right of each split, swept from the right
+            std::array<float, BIN_COUNT> right_cost{};
+            light_bounds right;
+            for (int i = BIN_COUNT - 1; i > 0; i--)
+            {
+                right = light_bounds::merge(right, bins[i].b);
+                right_cost[i - 1] = cost(right, total.bounds, axis);
+            }
+
+            light_bounds left;
+            uint32_t left_count = 0;
+            for (int i = 0; i < BIN_COUNT - 1; i++)
+            {
+                left = light_bounds::merge(left, bins[i].b);
+                left_count += bins[i].count;
+                if (left_count == 0 || left_count == end - begin) continue;
+                const float c = cost(left, total.bounds, axis) + right_cost[i];
+                if (c < best_cost)
+                {
+                    best_cost = c;
+                    best_axis = axis;
+                    best_bin = i;
+                }
+            }
+        }
+
+        if (best_axis >= 0)
+        {
+            const auto first_right = std::partition(indices.begin() + begin, indices.begin() + end, [&](const uint32_t e)
+            {
+                return bin_index(centroid_bounds, best_axis, emitters[e].bounds.centroid()[best_axis]) <= best_bin;
+            });
+            return static_cast<uint32_t>(first_right - indices.begin());
+        }
+
+        // no useful split (or too deep): halve by count along the widest centroid axis
+        const int axis = centroid_bounds.longest_axis();
+        const uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+                         [&](const uint32_t a, const uint32_t b)
+                         {
+                             return emitters[a].bounds.centroid()[axis] < emitters[b].bounds.centroid()[axis];
+                         });
+        return mid;
+    }
+
+    static int bin_index(const aabb& centroid_bounds, const int axis, const float c)
+    {
+        const float lo = centroid_bounds.min[axis];
+        const float extent = centroid_bounds.max[axis] - lo;
+        const float b = (c - lo) * (static_cast<float>(BIN_COUNT) / extent);
+        if (!(b > 0.0f)) return 0;
+        return b >= static_cast<float>(BIN_COUNT - 1) ? BIN_COUNT - 1 : static_cast<int>(b);
+    }
+
+    // power x normal spread x surface area, the spread being the solid angle the cone of normals
+    // widened by the pi/2 a diffuse emitter lights around each normal; splits along a short axis
+    // of the parent are penalised so flat groups are not cut into slivers
+    static float cost(const light_bounds& b, const aabb& parent, const int axis)
+    {
+        if (b.power <= 0.0f) return 0.0f;
+        constexpr float pi = static_cast<float>(M_PI);
+        const float theta_o = std::acos(std::clamp(b.cone.cos_theta_o, -1.0f, 1.0f));
+        const float theta_w = std::min(theta_o + pi * 0.5f, pi);
+        const float sin_o = std::sin(theta_o);
+        const float spread = 2.0f * pi * (1.0f - b.cone.cos_theta_o) +
+                             pi * 0.5f * (2.0f * theta_w * sin_o - std::cos(theta_o - 2.0f * theta_w) -
+                                          2.0f * theta_o * sin_o + b.cone.cos_theta_o);
+
+        const vector3 e = parent.extent();
+        const float longest = std::max({e.x, e.y, e.z});
+        const float regularise = e[axis] > 0.0f ? longest / e[axis] : 1.0f;
+        return b.power * spread * regularise * b.bounds.surface_area();
+    }
+};
+
+#endif // RAY_TRACER_LIGHT_BVH_BUILDER
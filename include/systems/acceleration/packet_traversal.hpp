@@ -0,0 +1,79 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - packet_traversal.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_PACKET_TRAVERSAL
+#define RAY_TRACER_PACKET_TRAVERSAL
+
+#include <cstdint>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/acceleration/traversal_stats.hpp"
+#include "components/math/ray_packet.hpp"
+#include "systems/math/packet_intersection.hpp"
+
+// Closest hit traversal of a whole packet at once. Every node is tested
+// against all rays still active in it, and a subtree is only entered while
+// at least one ray reaches it. For every primitive in a leaf,
+// hit_prims(prim_index, lanes) is called with the rays that reached the leaf;
+// it should record closer hits in the packet's t_max and prim.
+// Children are ordered by the first ray's direction, so the packet should
+// be coherent (see ray_packet::coherent). Stats count node visits per packet.
+template <int N, typename HitFn>
+void traverse_bvh_packet(const bvh& b, ray_packet<N>& p, HitFn&& hit_prims, traversal_stats* stats = nullptr)
+{
+    if (b.empty() || !p.active) return;
+    if (stats) stats->rays += __builtin_popcount(p.active);
+
+    const int first = __builtin_ctz(p.active);
+    const bool dir_is_neg[3] = {p.dx[first] < 0.0f, p.dy[first] < 0.0f, p.dz[first] < 0.0f};
+
+    struct entry
+    {
+        uint32_t node;
+        uint32_t lanes; // rays that reached the parent, a subset of them can reach this node
+    };
+
+    entry stack[bvh::MAX_DEPTH];
+    int stack_size = 0;
+    entry current{0, p.active};
+
+    while (true)
+    {
+        const bvh_node& node = b.nodes[current.node];
+        if (stats) stats->nodes_visited++;
+
+        if (const uint32_t lanes = intersect_packet(p, node.bounds, current.lanes))
+        {
+            if (node.is_leaf())
+            {
+                if (stats) stats->prims_tested += node.prim_count;
+                for (uint32_t i = node.offset; i < node.offset + node.prim_count; i++)
+                    hit_prims(b.prim_indices[i], lanes);
+            }
+            else
+            {
+                if (dir_is_neg[node.axis])
+                {
+                    stack[stack_size++] = {current.node + 1, lanes};
+                    current = {node.offset, lanes};
+                }
+                else
+                {
+                    stack[stack_size++] = {node.offset, lanes};
+                    current = {current.node + 1, lanes};
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+}
+
+#endif // RAY_TRACER_PACKET_TRAVERSAL
@@ -0,0 +1,138 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - wide_bvh_builder.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_WIDE_BVH_BUILDER
+#define RAY_TRACER_WIDE_BVH_BUILDER
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "components/acceleration/bvh.hpp"
+#include "components/acceleration/wide_bvh.hpp"
+
+// Collapses a binary BVH into an N-wide one. Every wide node pulls in the
+// children of its binary node and keeps opening the largest interior child
+// until N lanes are filled, so the SAH split decisions are kept.
+struct wide_bvh_builder
+{
+    static constexpr uint32_t NO_LANE = UINT32_MAX;
+
+    // lane_map, when given, receives for every binary node the wide lane
+    // (wide node * N + lane) that copied its bounds, or NO_LANE if it was opened
+    template <int N>
+    static wide_bvh<N> collapse(const bvh& b, std::vector<uint32_t>* lane_map = nullptr)
+    {
+        wide_bvh<N> result;
+        result.prim_indices = b.prim_indices;
+        if (lane_map) lane_map->assign(b.nodes.size(), NO_LANE);
+        if (b.empty()) return result;
+
+        result.nodes.reserve(b.nodes.size() / (N - 1) + 1);
+
+        if (b.nodes[0].is_leaf())
+        {
+            // a single leaf still needs a node to hang off
+            auto& root = result.nodes.emplace_back();
+            set_lane(root, 0, b.nodes[0].bounds);
+            root.child[0] = b.nodes[0].offset;
+            root.prim_count[0] = b.nodes[0].prim_count;
+            root.child_count = 1;
+            result.leaf_count = 1;
+            if (lane_map) (*lane_map)[0] = 0;
+            return result;
+        }
+
+        collapse_node(b, 0, result, lane_map);
+        return result;
+    }
+
+    // copies refitted binary node bounds into the lanes that mirror them
+    template <int N>
+    static void refit_lanes(wide_bvh<N>& w, const std::vector<uint32_t>& lane_map, const bvh& b,
+                            const std::span<const uint32_t> refitted_nodes)
+    {
+        for (const uint32_t node : refitted_nodes)
+        {
+            const uint32_t lane = lane_map[node];
+            if (lane != NO_LANE) set_lane(w.nodes[lane / N], static_cast<int>(lane % N), b.nodes[node].bounds);
+        }
+    }
+
+private:
+    template <int N>
+    static uint32_t collapse_node(const bvh& b, const uint32_t binary_index, wide_bvh<N>& w,
+                                  std::vector<uint32_t>* lane_map)
+    {
+        const uint32_t node_index = static_cast<uint32_t>(w.nodes.size());
+        w.nodes.emplace_back();
+
+        uint32_t children[N];
+        int count = 2;
+        children[0] = binary_index + 1;
+        children[1] = b.nodes[binary_index].offset;
+
+        while (count < N)
+        {
+            int best = -1;
+            float best_area = -1.0f;
+            for (int i = 0; i < count; i++)
+            {
+                const bvh_node& c = b.nodes[children[i]];
+                if (!c.is_leaf() && c.bounds.surface_area() > best_area)
+                {
+                    best_area = c.bounds.surface_area();
+                    best = i;
+                }
+            }
+            if (best < 0) break;
+
+            const uint32_t opened = children[best];
+            children[best] = opened + 1;
+            children[count++] = b.nodes[opened].offset;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            const bvh_node& c = b.nodes[children[i]];
+            uint32_t child = c.offset;
+            if (c.is_leaf()) w.leaf_count++;
+            else child = collapse_node(b, children[i], w, lane_map); // may grow w.nodes, so index it afresh below
+            if (lane_map) (*lane_map)[children[i]] = node_index * N + i;
+
+            wide_bvh_node<N>& node = w.nodes[node_index];
+            set_lane(node, i, c.bounds);
+            node.child[i] = child;
+            node.prim_count[i] = c.prim_count;
+        }
+
+        wide_bvh_node<N>& node = w.nodes[node_index];
+        node.child_count = static_cast<uint8_t>(count);
+        for (int i = count; i < N; i++)
+        {
+            // unused lanes get a point box at the origin, the child_count mask rejects them anyway
+            set_lane(node, i, aabb(vector3(), vector3()));
+            node.child[i] = 0;
+            node.prim_count[i] = 0;
+        }
+        return node_index;
+    }
+
+    template <int N>
+    static void set_lane(wide_bvh_node<N>& node, const int lane, const aabb& box)
+    {
+        node.min_x[lane] = box.min.x;
+        node.min_y[lane] = box.min.y;
+        node.min_z[lane] = box.min.z;
+        node.max_x[lane] = box.max.x;
+        node.max_y[lane] = box.max.y;
+        node.max_z[lane] = box.max.z;
+    }
+};
+
+#endif // RAY_TRACER_WIDE_BVH_BUILDER
@@ -0,0 +1,336 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - wide_bvh_traversal.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_WIDE_BVH_TRAVERSAL
+#define RAY_TRACER_WIDE_BVH_TRAVERSAL
+
+#include <algorithm>
+#include <cstdint>
+
+#include "systems/platform/cpu_features.hpp"
+
+#if RAY_TRACER_X86
+#include <immintrin.h>
+#endif
+
+#include "components/acceleration/bvh.hpp"
+#include "components/acceleration/traversal_stats.hpp"
+#include "components/acceleration/wide_bvh.hpp"
+#include "components/math/ray.hpp"
+#include "components/rendering/render_settings.hpp"
+#include "systems/acceleration/bvh_traversal.hpp"
+
+// ray data splatted once per traversal
+struct wide_ray
+{
+    vector3 origin;
+    vector3 inv_dir;
+
+    explicit wide_ray(const ray& r)
+        : origin(r.origin), inv_dir(1.0f / r.direction.x, 1.0f / r.direction.y, 1.0f / r.direction.z) {}
+};
+
+// ---------------------- Child Slab Tests ----------------------
+// Test the ray against lanes [first, first+W) of a node. Returns a bit per
+// lane that is hit before t_max, and writes the entry distance of every lane.
+
+template <int N>
+inline uint32_t intersect_lanes_scalar(const wide_bvh_node<N>& node, const int first, const int width,
+                                       const wide_ray& wr, const float t_max, float* t_near)
+{
+    uint32_t mask = 0;
+    for (int i = first; i < first + width; i++)
+    {
+        const float tx1 = (node.min_x[i] - wr.origin.x) * wr.inv_dir.x;
+        const float tx2 = (node.max_x[i] - wr.origin.x) * wr.inv_dir.x;
+        const float ty1 = (node.min_y[i] - wr.origin.y) * wr.inv_dir.y;
+        const float ty2 = (node.max_y[i] - wr.origin.y) * wr.inv_dir.y;
+        const float tz1 = (node.min_z[i] - wr.origin.z) * wr.inv_dir.z;
+        const float tz2 = (node.max_z[i] - wr.origin.z) * wr.inv_dir.z;
+
+        const float t0 = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), 0.0f));
+        const float t1 = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), t_max));
+
+        t_near[i] = t0;
+        mask |= static_cast<uint32_t>(t0 <= t1) << i;
+    }
+    return mask;
+}
+
+#if RAY_TRACER_X86
+template <int N>
+RAY_TRACER_TARGET_SSE42 inline uint32_t intersect_lanes_sse(const wide_bvh_node<N>& node, const int first,
+                                    const wide_ray& wr, const float t_max, float* t_near)
+{
+    const __m128 ox = _mm_set1_ps(wr.origin.x), oy = _mm_set1_ps(wr.origin.y), oz = _mm_set1_ps(wr.origin.z);
+    const __m128 ix = _mm_set1_ps(wr.inv_dir.x), iy = _mm_set1_ps(wr.inv_dir.y), iz = _mm_set1_ps(wr.inv_dir.z);
+
+    const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x + first), ox), ix);
+    const __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x + first), ox), ix);
+    const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y + first), oy), iy);
+    const __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y + first), oy), iy);
+    const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z + first), oz), iz);
+    const __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z + first), oz), iz);
+
+    const __m128 t0 = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+                                 _mm_max_ps(_mm_min_ps(tz1, tz2), _mm_setzero_ps()));
+    const __m128 t1 = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)),
+                                 _mm_min_ps(_mm_max_ps(tz1, tz2), _mm_set1_ps(t_max)));
+
+    _mm_storeu_ps(t_near + first, t0);
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(t0, t1))) << first;
+}
+
+RAY_TRACER_TARGET_AVX2 inline uint32_t intersect_lanes_avx2(const wide_bvh_node<8>& node, const wide_ray& wr,
+                                                            const float t_max, float* t_near)
+{
+    const __m256 ox = _mm256_set1_ps(wr.origin.x), oy = _mm256_set1_ps(wr.origin.y), oz = _mm256_set1_ps(wr.origin.z);
+    const __m256 ix = _mm256_set1_ps(wr.inv_dir.x), iy = _mm256_set1_ps(wr.inv_dir.y), iz = _mm256_set1_ps(wr.inv_dir.z);
+
+    const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_x), ox), ix);
+    const __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_x), ox), ix);
+    const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_y), oy), iy);
+    const __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_y), oy), iy);
+    const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_z), oz), iz);
+    const __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_z), oz), iz);
+
+    const __m256 t0 = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)),
+                                    _mm256_max_ps(_mm256_min_ps(tz1, tz2), _mm256_setzero_ps()));
+    const __m256 t1 = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2)),
+                                    _mm256_min_ps(_mm256_max_ps(tz1, tz2), _mm256_set1_ps(t_max)));
+
+    _mm256_storeu_ps(t_near, t0);
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ)));
+}
+
+// the AVX2 test with the compare going straight into a mask register
+RAY_TRACER_TARGET_AVX512 inline uint32_t intersect_lanes_avx512(const wide_bvh_node<8>& node, const wide_ray& wr,
+                                                                const float t_max, float* t_near)
+{
+    const __m256 ox = _mm256_set1_ps(wr.origin.x), oy = _mm256_set1_ps(wr.origin.y), oz = _mm256_set1_ps(wr.origin.z);
+    const __m256 ix = _mm256_set1_ps(wr.inv_dir.x), iy = _mm256_set1_ps(wr.inv_dir.y), iz = _mm256_set1_ps(wr.inv_dir.z);
+
+    const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_x), ox), ix);
+    const __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_x), ox), ix);
+    const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_y), oy), iy);
+    const __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_y), oy), iy);
+    const __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_z), oz), iz);
+    const __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_z), oz), iz);
+
+    const __m256 t0 = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)),
+                                    _mm256_max_ps(_mm256_min_ps(tz1, tz2), _mm256_setzero_ps()));
+    const __m256 t1 = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2)),
+                                    _mm256_min_ps(_mm256_max_ps(tz1, tz2), _mm256_set1_ps(t_max)));
+
+    _mm256_storeu_ps(t_near, t0);
+    return _mm256_cmp_ps_mask(t0, t1, _CMP_LE_OQ);
+}
+#endif
+
+// the child test of instruction set level Isa, inlined into the traversal built for it
+template <isa Isa, int N>
+RAY_TRACER_ALWAYS_INLINE uint32_t intersect_children(const wide_bvh_node<N>& node, const wide_ray& wr, const float t_max,
+                                                     float* t_near)
+{
+    uint32_t mask;
+#if RAY_TRACER_X86
+    if constexpr (N == 8 && Isa == isa::avx512) mask = intersect_lanes_avx512(node, wr, t_max, t_near);
+    else if constexpr (N == 8 && Isa == isa::avx2) mask = intersect_lanes_avx2(node, wr, t_max, t_near);
+    else if constexpr (Isa != isa::scalar)
+    {
+        mask = intersect_lanes_sse(node, 0, wr, t_max, t_near);
+        if constexpr (N == 8) mask |= intersect_lanes_sse(node, 4, wr, t_max, t_near);
+    }
+    else
+#endif
+        mask = intersect_lanes_scalar(node, 0, N, wr, t_max, t_near);
+    return mask & ((1u << node.child_count) - 1u);
+}
+
+// ---------------------- Traversal ----------------------
+// Same contract as traverse_bvh: hit_prim(prim_index, t_max) tests one
+// primitive and shrinks t_max on a closer hit. The loop is built once per
+// instruction set level, traverse_wide_bvh below picks one per ray.
+template <isa Isa, int N, typename HitFn>
+RAY_TRACER_ALWAYS_INLINE void traverse_wide_bvh_with(const wide_bvh<N>& w, const ray& r, float& t_max, HitFn& hit_prim,
+                                                     traversal_stats* stats)
+{
+    if (w.empty()) return;
+    if (stats) stats->rays++;
+
+    struct entry
+    {
+        float t_near;
+        uint32_t child;
+        uint32_t prim_count; // 0 for interior nodes
+    };
+
+    // every visited node pushes at most N-1 entries per level
+    entry stack[bvh::MAX_DEPTH * (N - 1) + 1];
+    int stack_size = 0;
+    stack[stack_size++] = {0.0f, 0, 0};
+
+    const wide_ray wr(r);
+    alignas(32) float t_near[N];
+
+    while (stack_size > 0)
+    {
+        const entry e = stack[--stack_size];
+        if (e.t_near > t_max) continue;
+
+        if (e.prim_count > 0)
+        {
+            if (stats) stats->prims_tested += e.prim_count;
+            hit_leaf(hit_prim, &w.prim_indices[e.child], e.prim_count, t_max);
+            continue;
+        }
+
+        const wide_bvh_node<N>& node = w.nodes[e.child];
+        if (stats) stats->nodes_visited++;
+
+        uint32_t mask = intersect_children<Isa>(node, wr, t_max, t_near);
+        if (!mask) continue;
+
+        // push far to near so the nearest child is popped first
+        int lanes[N];
+        int hit_count = 0;
+        while (mask)
+        {
+            const int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+
+            int j = hit_count++;
+            while (j > 0 && t_near[lanes[j - 1]] < t_near[lane]) { lanes[j] = lanes[j - 1]; j--; }
+            lanes[j] = lane;
+        }
+        for (int i = 0; i < hit_count; i++)
+            stack[stack_size++] = {t_near[lanes[i]], node.child[lanes[i]], node.prim_count[lanes[i]]};
+    }
+}
+
+// Any hit counterpart of traverse_wide_bvh, see occluded_bvh. Children are
+// pushed as the hit mask lists them, without sorting by distance.
+template <isa Isa, int N, typename AnyHitFn>
+RAY_TRACER_ALWAYS_INLINE bool occluded_wide_bvh_with(const wide_bvh<N>& w, const ray& r, const float t_max,
+                                                     AnyHitFn& hit_prim, traversal_stats* stats)
+{
+    if (w.empty()) return false;
+    if (stats) stats->rays++;
+
+    struct entry
+    {
+        uint32_t child;
+        uint32_t prim_count; // 0 for interior nodes
+    };
+
+    entry stack[bvh::MAX_DEPTH * (N - 1) + 1];
+    int stack_size = 0;
+    stack[stack_size++] = {0, 0};
+
+    const wide_ray wr(r);
+    alignas(32) float t_near[N];
+
+    while (stack_size > 0)
+    {
+        const entry e = stack[--stack_size];
+
+        if (e.prim_count > 0)
+        {
+            if (any_hit_leaf(hit_prim, &w.prim_indices[e.child], e.prim_count, stats)) return true;
+            continue;
+        }
+
+        const wide_bvh_node<N>& node = w.nodes[e.child];
+        if (stats) stats->nodes_visited++;
+
+        for (uint32_t mask = intersect_children<Isa>(node, wr, t_max, t_near); mask; mask &= mask - 1)
+        {
+            const int lane = __builtin_ctz(mask);
+            stack[stack_size++] = {node.child[lane], node.prim_count[lane]};
+        }
+    }
+    return false;
+}
+
+// one entry point per level, so the child tests inline into a loop built for their instruction set
+#if RAY_TRACER_X86
+template <int N, typename HitFn>
+RAY_TRACER_TARGET_SSE42 void traverse_wide_bvh_sse(const wide_bvh<N>& w, const ray& r, float& t_max, HitFn& hit_prim,
+                                                   traversal_stats* stats)
+{
+    traverse_wide_bvh_with<isa::sse42>(w, r, t_max, hit_prim, stats);
+}
+
+template <int N, typename HitFn>
+RAY_TRACER_TARGET_AVX2 void traverse_wide_bvh_avx2(const wide_bvh<N>& w, const ray& r, float& t_max, HitFn& hit_prim,
+                                                   traversal_stats* stats)
+{
+    traverse_wide_bvh_with<isa::avx2>(w, r, t_max, hit_prim, stats);
+}
+
+template <int N, typename HitFn>
+RAY_TRACER_TARGET_AVX512 void traverse_wide_bvh_avx512(const wide_bvh<N>& w, const ray& r, float& t_max, HitFn& hit_prim,
+                                                       traversal_stats* stats)
+{
+    traverse_wide_bvh_with<isa::avx512>(w, r, t_max, hit_prim, stats);
+}
+
+template <int N, typename AnyHitFn>
+RAY_TRACER_TARGET_SSE42 bool occluded_wide_bvh_sse(const wide_bvh<N>& w, const ray& r, const float t_max,
+                                                   AnyHitFn& hit_prim, traversal_stats* stats)
+{
+    return occluded_wide_bvh_with<isa::sse42>(w, r, t_max, hit_prim, stats);
+}
+
+template <int N, typename AnyHitFn>
+RAY_TRACER_TARGET_AVX2 bool occluded_wide_bvh_avx2(const wide_bvh<N>& w, const ray& r, const float t_max,
+                                                   AnyHitFn& hit_prim, traversal_stats* stats)
+{
+    return occluded_wide_bvh_with<isa::avx2>(w, r, t_max, hit_prim, stats);
+}
+
+template <int N, typename AnyHitFn>
+RAY_TRACER_TARGET_AVX512 bool occluded_wide_bvh_avx512(const wide_bvh<N>& w, const ray& r, const float t_max,
+                                                       AnyHitFn& hit_prim, traversal_stats* stats)
+{
+    return occluded_wide_bvh_with<isa::avx512>(w, r, t_max, hit_prim, stats);
+}
+#endif
+
+// the version of render_settings::kernel_isa
+template <int N, typename HitFn>
+void traverse_wide_bvh(const wide_bvh<N>& w, const ray& r, float& t_max, HitFn&& hit_prim, traversal_stats* stats = nullptr)
+{
+#if RAY_TRACER_X86
+    switch (render_settings::global_settings.kernel_isa)
+    {
+        case isa::avx512: return traverse_wide_bvh_avx512(w, r, t_max, hit_prim, stats);
+        case isa::avx2: return traverse_wide_bvh_avx2(w, r, t_max, hit_prim, stats);
+        case isa::sse42: return traverse_wide_bvh_sse(w, r, t_max, hit_prim, stats);
+        case isa::scalar: break;
+    }
+#endif
+    traverse_wide_bvh_with<isa::scalar>(w, r, t_max, hit_prim, stats);
+}
+
+template <int N, typename AnyHitFn>
+bool occluded_wide_bvh(const wide_bvh<N>& w, const ray& r, const float t_max, AnyHitFn&& hit_prim, traversal_stats* stats = nullptr)
+{
+#if RAY_TRACER_X86
+    switch (render_settings::global_settings.kernel_isa)
+    {
+        case isa::avx512: return occluded_wide_bvh_avx512(w, r, t_max, hit_prim, stats);
+        case isa::avx2: return occluded_wide_bvh_avx2(w, r, t_max, hit_prim, stats);
+        case isa::sse42: return occluded_wide_bvh_sse(w, r, t_max, hit_prim, stats);
+        case isa::scalar: break;
+    }
+#endif
+    return occluded_wide_bvh_with<isa::scalar>(w, r, t_max, hit_prim, stats);
+}
+
+#endif // RAY_TRACER_WIDE_BVH_TRAVERSAL
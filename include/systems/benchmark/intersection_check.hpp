@@ -0,0 +1,204 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - intersection_check.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_INTERSECTION_CHECK
+#define RAY_TRACER_INTERSECTION_CHECK
+
+#include <chrono>
+#include <initializer_list>
+#include <iomanip>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "components/geometry/triangle.hpp"
+#include "components/geometry/triangle_record.hpp"
+#include "components/math/intersection.hpp"
+#include "components/math/ray.hpp"
+#include "components/scene/primitive_store.hpp"
+#include "systems/math/intersection.hpp"
+#include "systems/math/random.hpp"
+#include "systems/math/lane_intersection.hpp"
+#include "systems/platform/cpu_features.hpp"
+
+// Compares the intersection tests on prepared primitives against the plain
+// ones on random rays, and times both. Prints the number of rays whose
+// results differ in any way, which should be 0.
+struct intersection_check
+{
+    static size_t triangle_records(const size_t ray_count, std::ostream& out)
+    {
+        random::set_seed(0);
+
+        // small triangles near the origin and rays aimed at them, so about half of the rays hit
+        std::vector<triangle> triangles;
+        std::vector<triangle_record> records;
+        std::vector<ray> rays;
+        for (size_t i = 0; i < ray_count; i++)
+        {
+            const triangle t(random_point(), random_point(), random_point());
+            triangles.push_back(t);
+            records.emplace_back(t);
+
+            const vector3 origin = random_point() * 10.0f;
+            rays.emplace_back(origin, t.centroid() + random_point() * 0.5f - origin);
+        }
+
+        size_t hits = 0, mismatches = 0;
+        for (size_t i = 0; i < ray_count; i++)
+        {
+            intersection a, b;
+            const bool hit_a = intersect(rays[i], triangles[i], a);
+            const bool hit_b = intersect(rays[i], records[i], b);
+            hits += hit_a;
+            if (hit_a != hit_b) mismatches++;
+            else if (hit_a && (a.intersection_distance != b.intersection_distance || a.back_face != b.back_face ||
+                               a.normal.x != b.normal.x || a.normal.y != b.normal.y || a.normal.z != b.normal.z))
+                mismatches++;
+        }
+
+        const double triangle_s = time_tests(rays, triangles);
+        const double record_s = time_tests(rays, records);
+
+        out << "triangle records: " << ray_count << " rays, " << hits << " hits, " << mismatches << " mismatches, "
+            << std::fixed << std::setprecision(1) << ray_count / triangle_s / 1e6 << " -> "
+            << ray_count / record_s / 1e6 << " M tests/s\n" << std::defaultfloat;
+        return mismatches;
+    }
+
+    // one ray against each group of 8 triangles in the lanes, through every version of the
+    // 8-wide kernel this CPU runs; each must pick the scalar one's triangle at its distance
+    static size_t triangle_kernels(const size_t ray_count, std::ostream& out)
+    {
+        random::set_seed(0);
+
+        // 8 overlapping triangles per group, so a ray often hits more than one of them
+        primitive_store ps; // material ids are left at 0, nothing here reads them
+        std::vector<ray> rays;
+        for (size_t i = 0; i < ray_count; i++)
+        {
+            const vector3 center = random_point() * 0.2f;
+            for (int j = 0; j < 8; j++)
+                ps.add((object){triangle(center + random_point(), center + random_point(), center + random_point()), 0});
+            rays.push_back(ray_towards(center));
+        }
+
+        return compare_kernels<primitive_store::triangle_lanes, triangle_kernel>("triangle kernel", ps.triangles, rays, out, {
+            {isa::scalar, intersect_triangles_scalar<primitive_store::triangle_lanes>},
+#if RAY_TRACER_X86
+            {isa::sse42, intersect_triangles_sse<primitive_store::triangle_lanes>},
+            {isa::avx2, intersect_triangles_avx2<primitive_store::triangle_lanes>},
+            {isa::avx512, intersect_triangles_avx512<primitive_store::triangle_lanes>},
+#endif
+        });
+    }
+
+    // the same for clusters of 8 spheres, as a leaf of a particle cloud holds them
+    static size_t sphere_kernels(const size_t ray_count, std::ostream& out)
+    {
+        random::set_seed(0);
+
+        primitive_store ps; // material ids are left at 0, nothing here reads them
+        std::vector<ray> rays;
+        for (size_t i = 0; i < ray_count; i++)
+        {
+            const vector3 center = random_point() * 0.2f;
+            for (int j = 0; j < 8; j++)
+                ps.add((object){sphere(center + random_point() * 0.5f, 0.1f + randf() * 0.3f), 0});
+            rays.push_back(ray_towards(center));
+        }
+
+        return compare_kernels<primitive_store::sphere_lanes, sphere_kernel>("sphere kernel", ps.spheres, rays, out, {
+            {isa::scalar, intersect_spheres_scalar},
+#if RAY_TRACER_X86
+            {isa::sse42, intersect_spheres_sse},
+            {isa::avx2, intersect_spheres_avx2},
+            {isa::avx512, intersect_spheres_avx512},
+#endif
+        });
+    }
+
+private:
+    // the triangle kernels also return the barycentrics of the hit
+    using triangle_kernel = int (*)(const primitive_store::triangle_lanes&, uint32_t, int, const ray&, float&, float&, float&);
+    using sphere_kernel = int (*)(const primitive_store::sphere_lanes&, uint32_t, int, const ray&, float&);
+
+    static vector3 random_point()
+    {
+        return vector3(randf(), randf(), randf()) * 2.0f - vector3(1, 1, 1);
+    }
+
+    // from a random point outside, at about the given point, so most rays hit near it
+    static ray ray_towards(const vector3& target)
+    {
+        const vector3 origin = random_point() * 10.0f;
+        return {origin, target + random_point() * 0.5f - origin};
+    }
+
+    // times every kernel on ray i against slots [8i, 8i+8), the first one is the reference the
+    // others must match in lane, distance and barycentrics; prints M primitive tests/s per kernel,
+    // skipping the levels this CPU does not have
+    template <typename Lanes, typename Kernel>
+    static size_t compare_kernels(const char* name, const Lanes& lanes, const std::vector<ray>& rays, std::ostream& out,
+                                  std::initializer_list<std::pair<isa, Kernel>> kernels)
+    {
+        struct result
+        {
+            int lane;
+            float t, u, v;
+            bool operator==(const result&) const = default;
+        };
+        std::vector<result> expected, results(rays.size());
+        size_t mismatches = 0;
+
+        out << name << ": " << rays.size() << " rays x 8, M tests/s:" << std::fixed << std::setprecision(1);
+        for (const auto& [level, kernel] : kernels)
+        {
+            if (!isa_supported(level)) continue;
+            const auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < rays.size(); i++)
+            {
+                result& res = results[i];
+                res = {-1, 1e30f, 0.0f, 0.0f};
+                if constexpr (std::is_same_v<Kernel, triangle_kernel>)
+                    res.lane = kernel(lanes, static_cast<uint32_t>(i * 8), 8, rays[i], res.t, res.u, res.v);
+                else
+                    res.lane = kernel(lanes, static_cast<uint32_t>(i * 8), 8, rays[i], res.t);
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            out << " " << isa_name(level) << " " << rays.size() * 8 / elapsed.count() / 1e6;
+
+            if (expected.empty()) expected = results;
+            else
+                for (size_t i = 0; i < rays.size(); i++) mismatches += !(results[i] == expected[i]);
+        }
+
+        size_t hits = 0;
+        for (const result& res : expected) hits += res.lane >= 0;
+        out << ", " << hits << " hits, " << mismatches << " mismatches\n" << std::defaultfloat;
+        return mismatches;
+    }
+
+    template <typename Shape>
+    static double time_tests(const std::vector<ray>& rays, const std::vector<Shape>& shapes)
+    {
+        float sink = 0.0f;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < rays.size(); i++)
+            if (intersection is; intersect(rays[i], shapes[i], is)) sink += is.normal.x;
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        // keeps the loop from being optimised away
+        volatile float keep = sink;
+        (void)keep;
+        return elapsed.count();
+    }
+};
+
+#endif // RAY_TRACER_INTERSECTION_CHECK
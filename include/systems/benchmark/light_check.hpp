@@ -0,0 +1,82 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - light_check.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_LIGHT_CHECK
+#define RAY_TRACER_LIGHT_CHECK
+
+#include <cmath>
+#include <initializer_list>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "components/geometry/sphere.hpp"
+#include "components/geometry/triangle.hpp"
+#include "components/math/transform.hpp"
+#include "components/rendering/camera.hpp"
+#include "components/rendering/material.hpp"
+#include "components/rendering/render_settings.hpp"
+#include "components/scene/scene.hpp"
+#include "systems/math/random.hpp"
+
+// Renders small scenes with bounces alone, with direct light sampling weighted by MIS and with
+// direct light sampling alone. All three estimate the same image, so their mean radiance must
+// agree up to noise; prints the means and returns the number of renders off by more than tolerance.
+struct light_check
+{
+    // an emissive sphere over a diffuse floor, placed through an instance with transform
+    static size_t instanced_sphere_light(const char* name, const transform& to_world, const int size, const int spp,
+                                         std::ostream& out, const float tolerance = 0.03f)
+    {
+        scene s{};
+        const material_id floor = s.add_material(material(color(0.8f), 0));
+        const material_id lamp = s.add_material(material(color(0.0f), 0, color(4.0f)));
+        s.add_object((object){triangle(vector3(-20, 0, -20), vector3(20, 0, 20), vector3(20, 0, -20)), floor});
+        s.add_object((object){triangle(vector3(-20, 0, -20), vector3(-20, 0, 20), vector3(20, 0, 20)), floor});
+        s.add_instance(s.add_prototype({(object){sphere(vector3(0, 0, 0), 1.0f), lamp}}), to_world);
+        s.build_acceleration();
+
+        const camera cam(vector3(0, 6, 8), vector3(0, 0, 0), vector3(0, 1, 0), 0.8f, 1.0f);
+
+        const render_settings saved = render_settings::global_settings;
+        render_settings& settings = render_settings::global_settings;
+        settings.debug = debug::off;
+        settings.reservoir_resampling = false;
+
+        struct mode { const char* name; bool nee, mis; };
+        double reference = 0.0;
+        size_t failures = 0;
+        out << "light check, " << name << ":" << std::fixed << std::setprecision(4);
+        for (const mode& m : {mode{"bounces", false, false}, mode{"nee+mis", true, true}, mode{"nee", true, false}})
+        {
+            settings.next_event_estimation = m.nee;
+            settings.multiple_importance_sampling = m.mis;
+            random::set_seed(0);
+
+            double sum = 0.0;
+            for (int y = 0; y < size; y++)
+                for (int x = 0; x < size; x++)
+                    for (int i = 0; i < spp; i++)
+                    {
+                        const color c = s.trace_ray(cam.generate_ray((x + randf()) / size, (y + randf()) / size), 0);
+                        sum += c.r + c.g + c.b;
+                    }
+            const double mean = sum / (3.0 * size * size * spp);
+
+            if (!m.nee) reference = mean;
+            else failures += std::fabs(mean - reference) > tolerance * reference;
+            out << " " << m.name << " " << mean;
+        }
+        out << (failures ? ", MISMATCH\n" : "\n") << std::defaultfloat;
+
+        render_settings::global_settings = saved;
+        return failures;
+    }
+};
+
+#endif // RAY_TRACER_LIGHT_CHECK
@@ -0,0 +1,119 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - math_benchmark.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_MATH_BENCHMARK
+#define RAY_TRACER_MATH_BENCHMARK
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "components/geometry/sphere.hpp"
+#include "components/geometry/triangle.hpp"
+#include "components/math/intersection.hpp"
+#include "components/math/ray.hpp"
+#include "components/math/simd_math.hpp"
+#include "components/math/vector3.hpp"
+#include "components/rendering/camera.hpp"
+#include "components/rendering/color.hpp"
+#include "systems/math/intersection.hpp"
+#include "systems/math/random.hpp"
+
+// Times the vector3-heavy paths under the layout this build picked (see simd_math.hpp).
+// Each line ends in a checksum of the results, which should not change with the layout.
+struct math_benchmark
+{
+    static void run(const size_t count, std::ostream& out)
+    {
+        out << "vector math: " << (RAY_TRACER_SIMD_VECTOR ? "float4 SSE" : "scalar") << " layout, vector3 "
+            << sizeof(vector3) << " B, color " << sizeof(color) << " B\n";
+
+        random::set_seed(0);
+        std::vector<vector3> normals(count);
+        for (vector3& n : normals) n = random_unit();
+
+        random::set_seed(0);
+        time_path("random_cosine_hemisphere", count, out, [&](const size_t i)
+        {
+            const vector3 d = random_cosine_hemisphere(normals[i]);
+            return d.x + d.y + d.z;
+        });
+
+        // a path's throughput and radiance over a few bounces, as shade() builds them
+        time_path("color throughput", count, out, [&](const size_t i)
+        {
+            const color albedo(normals[i].x * 0.5f + 0.5f, normals[i].y * 0.5f + 0.5f, normals[i].z * 0.5f + 0.5f);
+            color throughput(1.0f), radiance;
+            for (int bounce = 0; bounce < 4; bounce++)
+            {
+                radiance += throughput * albedo * 0.25f;
+                throughput = throughput * albedo;
+            }
+            return radiance.clamped().luminance();
+        });
+
+        const camera cam(vector3(9, 8, 9), vector3(0, 0, 0), vector3(0, 1, 0), 0.5f, 16.0f / 9.0f);
+        const auto side = static_cast<size_t>(std::sqrt(static_cast<double>(count)));
+        time_path("camera::generate_ray", count, out, [&](const size_t i)
+        {
+            const ray r = cam.generate_ray(static_cast<float>(i % side) / side, static_cast<float>(i / side) / side);
+            return r.direction.x + r.direction.y + r.direction.z;
+        });
+
+        // rays from around the shape towards a point near it, most of them hit
+        random::set_seed(0);
+        std::vector<ray> rays;
+        std::vector<sphere> spheres;
+        std::vector<triangle> triangles;
+        rays.reserve(count);
+        spheres.reserve(count);
+        triangles.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const vector3 center = random_unit() * 2.0f;
+            spheres.emplace_back(center, 0.5f + randf());
+            triangles.emplace_back(center + random_unit(), center + random_unit(), center + random_unit());
+            const vector3 origin = random_unit() * 10.0f;
+            rays.emplace_back(origin, center + random_unit() * 0.5f - origin);
+        }
+
+        time_path("intersect(sphere)", count, out, [&](const size_t i)
+        {
+            intersection is;
+            return intersect(rays[i], spheres[i], is) ? is.intersection_distance + is.normal.x : 0.0f;
+        });
+        time_path("intersect(triangle)", count, out, [&](const size_t i)
+        {
+            intersection is;
+            return intersect(rays[i], triangles[i], is) ? is.intersection_distance + is.normal.x : 0.0f;
+        });
+    }
+
+private:
+    static vector3 random_unit()
+    {
+        return (vector3(randf(), randf(), randf()) * 2.0f - vector3(1, 1, 1)).normalized();
+    }
+
+    template <typename Path>
+    static void time_path(const char* name, const size_t count, std::ostream& out, Path&& path)
+    {
+        double checksum = 0.0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < count; i++) checksum += path(i);
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        out << "  " << std::left << std::setw(26) << name << std::right << std::fixed << std::setprecision(1)
+            << std::setw(8) << count / elapsed.count() / 1e6 << " M/s   checksum " << std::setprecision(6)
+            << checksum << "\n" << std::defaultfloat;
+    }
+};
+
+#endif // RAY_TRACER_MATH_BENCHMARK
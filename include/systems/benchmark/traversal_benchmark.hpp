@@ -0,0 +1,276 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - traversal_benchmark.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_TRAVERSAL_BENCHMARK
+#define RAY_TRACER_TRAVERSAL_BENCHMARK
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "components/acceleration/traversal_stats.hpp"
+#include "components/rendering/camera.hpp"
+#include "components/rendering/render_settings.hpp"
+#include "components/scene/scene.hpp"
+#include "systems/math/random.hpp"
+
+// Traces the same ray set through every traversal backend and prints
+// nodes visited, primitives tested and rays per second for each. Then
+// compares primary rays traced alone and in packets, and shadow rays
+// through closest_hit and through the any-hit occluded.
+struct traversal_benchmark
+{
+    struct shadow_ray
+    {
+        ray r;
+        float t_max;
+    };
+
+    static void run(scene& s, const camera& cam, const char* scene_name,
+                    const int width, const int height, std::ostream& out)
+    {
+        const traversal_backend previous = render_settings::global_settings.traversal;
+
+        // built first: the bounce rays come from closest hits, which only see instances through the TLAS
+        s.build_acceleration();
+        const std::vector<ray> rays = make_rays(s, cam, width, height);
+
+        const primitive_store& prims = s.primitives();
+        const double per_prim = prims.size() ? static_cast<double>(prims.memory_bytes()) / prims.size() : 0.0;
+        const double geometry_per_prim = prims.size() ? static_cast<double>(prims.geometry_bytes()) / prims.size() : 0.0;
+        out << scene_name << ": " << s.object_count() << " objects, " << rays.size() << " rays, "
+            << std::fixed << std::setprecision(1) << per_prim << " B/primitive (" << geometry_per_prim
+            << " B of geometry, " << sizeof(object) << " B as variant objects)\n" << std::defaultfloat;
+        out << "  backend   nodes/ray   prims/ray    Mrays/s   hits\n";
+
+        for (const auto& [backend, name] : {std::pair{traversal_backend::binary, "binary"},
+                                            std::pair{traversal_backend::bvh4, "bvh4"},
+                                            std::pair{traversal_backend::bvh8, "bvh8"}})
+        {
+            render_settings::global_settings.traversal = backend;
+            s.build_acceleration();
+
+            // one untimed pass with counters, one timed pass without them
+            traversal_stats stats;
+            size_t hits = 0;
+            for (const ray& r : rays)
+            {
+                intersection is;
+                if (s.closest_hit(r, is, &stats)) hits++;
+            }
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            for (const ray& r : rays)
+            {
+                intersection is;
+                (void)s.closest_hit(r, is);
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            const auto ray_count = static_cast<double>(rays.size());
+            out << "  " << std::left << std::setw(8) << name << std::right << std::fixed
+                << std::setw(10) << std::setprecision(2) << static_cast<double>(stats.nodes_visited) / ray_count
+                << std::setw(12) << std::setprecision(2) << static_cast<double>(stats.prims_tested) / ray_count
+                << std::setw(11) << std::setprecision(2) << ray_count / elapsed.count() / 1e6
+                << std::setw(7) << hits << "\n" << std::defaultfloat;
+        }
+        print_memory(s, out);
+
+        // primary rays alone, one at a time on the binary BVH against 8 and 16 ray packets;
+        // they come first in rays, in scanline order, so neighbours share a packet
+        render_settings::global_settings.traversal = traversal_backend::binary;
+        s.build_acceleration();
+        const size_t primary_count = static_cast<size_t>(width) * height;
+        out << "  primary rays: " << primary_count << "\n";
+        out << "  mode      nodes/ray   prims/ray    Mrays/s   hits\n";
+        run_primary(s, rays.data(), primary_count, 1, "single", out);
+        run_primary(s, rays.data(), primary_count, 8, "packet8", out);
+        run_primary(s, rays.data(), primary_count, 16, "packet16", out);
+
+        const std::vector<shadow_ray> shadow_rays = make_shadow_rays(s, rays);
+        out << "  shadow rays: " << shadow_rays.size() << "\n";
+        out << "  backend   nodes/ray   prims/ray  closest Mrays/s  any-hit Mrays/s  blocked\n";
+
+        for (const auto& [backend, name] : {std::pair{traversal_backend::binary, "binary"},
+                                            std::pair{traversal_backend::bvh4, "bvh4"},
+                                            std::pair{traversal_backend::bvh8, "bvh8"}})
+        {
+            render_settings::global_settings.traversal = backend;
+            s.build_acceleration();
+
+            traversal_stats stats;
+            size_t blocked = 0;
+            for (const shadow_ray& sr : shadow_rays)
+                if (s.occluded(sr.r, sr.t_max, &stats)) blocked++;
+
+            // visibility through the closest hit, what a shadow ray cost before occluded existed
+            auto start = std::chrono::high_resolution_clock::now();
+            for (const shadow_ray& sr : shadow_rays)
+            {
+                intersection is;
+                (void)(s.closest_hit(sr.r, is) && is.intersection_distance < sr.t_max);
+            }
+            const std::chrono::duration<double> closest = std::chrono::high_resolution_clock::now() - start;
+
+            start = std::chrono::high_resolution_clock::now();
+            for (const shadow_ray& sr : shadow_rays)
+                (void)s.occluded(sr.r, sr.t_max);
+            const std::chrono::duration<double> any_hit = std::chrono::high_resolution_clock::now() - start;
+
+            const auto ray_count = static_cast<double>(shadow_rays.size());
+            out << "  " << std::left << std::setw(8) << name << std::right << std::fixed
+                << std::setw(10) << std::setprecision(2) << static_cast<double>(stats.nodes_visited) / ray_count
+                << std::setw(12) << std::setprecision(2) << static_cast<double>(stats.prims_tested) / ray_count
+                << std::setw(17) << std::setprecision(2) << ray_count / closest.count() / 1e6
+                << std::setw(17) << std::setprecision(2) << ray_count / any_hit.count() / 1e6
+                << std::setw(9) << blocked << "\n" << std::defaultfloat;
+        }
+
+        render_settings::global_settings.traversal = previous;
+        s.build_acceleration();
+    }
+
+private:
+    // where the bytes go, with what a material copy per primitive would cost instead of the table
+    static void print_memory(const scene& s, std::ostream& out)
+    {
+        const scene_memory m = s.memory();
+        const auto kb = [](const size_t bytes) { return static_cast<double>(bytes) / 1024.0; };
+        out << std::fixed << std::setprecision(1) << "  memory: " << kb(m.total()) << " KB = geometry "
+            << kb(m.geometry) << " + mesh attributes " << kb(m.mesh_attributes) << " + material ids "
+            << kb(m.material_ids) << " + " << s.material_count() << " materials " << kb(m.materials)
+            << " (copied per primitive: " << kb(s.object_count() * sizeof(material)) << ") + BVHs "
+            << kb(m.acceleration) << " + instancing " << kb(m.instancing) << " + lights " << kb(m.lights) << "\n"
+            << std::defaultfloat;
+    }
+
+    static void run_primary(const scene& s, const ray* rays, const size_t count, const int packet_size,
+                            const char* name, std::ostream& out)
+    {
+        const auto trace = [&](traversal_stats* stats)
+        {
+            size_t hits = 0;
+            intersection is[16];
+            const material* hit_mats[16];
+            for (size_t i = 0; i < count; i += packet_size)
+            {
+                const int n = static_cast<int>(std::min<size_t>(packet_size, count - i));
+                if (packet_size == 16) s.closest_hit_packet<16>(rays + i, n, is, hit_mats, stats);
+                else if (packet_size == 8) s.closest_hit_packet<8>(rays + i, n, is, hit_mats, stats);
+                else hit_mats[0] = s.closest_hit(rays[i], is[0], stats);
+                for (int j = 0; j < n; j++) hits += hit_mats[j] != nullptr;
+            }
+            return hits;
+        };
+
+        traversal_stats stats;
+        const size_t hits = trace(&stats);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        (void)trace(nullptr);
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        // packet traversal counts one visit per packet, shown per ray like the single ray counts
+        const auto ray_count = static_cast<double>(count);
+        out << "  " << std::left << std::setw(8) << name << std::right << std::fixed
+            << std::setw(10) << std::setprecision(2) << static_cast<double>(stats.nodes_visited) / ray_count
+            << std::setw(12) << std::setprecision(2) << static_cast<double>(stats.prims_tested) / ray_count
+            << std::setw(11) << std::setprecision(2) << ray_count / elapsed.count() / 1e6
+            << std::setw(7) << hits << "\n" << std::defaultfloat;
+    }
+
+    // one primary ray per pixel plus one diffuse bounce from every primary hit,
+    // so both coherent and incoherent rays are in the mix
+    static std::vector<ray> make_rays(const scene& s, const camera& cam, const int width, const int height)
+    {
+        random::set_seed(0);
+
+        std::vector<ray> rays;
+        rays.reserve(2 * width * height);
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                rays.push_back(cam.generate_ray((x + .5f) / static_cast<float>(width), (y + .5f) / static_cast<float>(height)));
+
+        const size_t primary_count = rays.size();
+        for (size_t i = 0; i < primary_count; i++)
+        {
+            const ray r = rays[i];
+            if (intersection is; s.closest_hit(r, is))
+            {
+                const vector3 hit_pos = r.at(is.intersection_distance);
+                const vector3 nl = vector3::dot(is.normal, r.direction) > 0.0f ? -is.normal : is.normal;
+                rays.emplace_back(hit_pos + nl * 1e-4f, random_cosine_hemisphere(nl));
+            }
+        }
+        return rays;
+    }
+
+    // From every primary hit towards one point light, like a shadow ray to a lamp. The light is the
+    // candidate that leaves a sample of these rays closest to half blocked: a point near the top of a
+    // closed room, above an open scene, never one buried inside a solid where every ray stops.
+    static std::vector<shadow_ray> make_shadow_rays(const scene& s, const std::vector<ray>& rays)
+    {
+        aabb bounds;
+        if (!s.acceleration().empty()) bounds = s.acceleration().nodes[0].bounds;
+        if (bounds.empty()) return {};
+
+        std::vector<vector3> origins;
+        for (const ray& r : rays)
+        {
+            intersection is;
+            if (!s.closest_hit(r, is)) continue;
+            const vector3 nl = vector3::dot(is.normal, r.direction) > 0.0f ? -is.normal : is.normal;
+            origins.push_back(r.at(is.intersection_distance) + nl * 1e-4f);
+        }
+
+        const vector3 center = bounds.centroid(), extent = bounds.extent();
+        const vector3 candidates[] = {
+            vector3(center.x, bounds.max.y - 0.01f * extent.y, center.z),
+            vector3(center.x, bounds.max.y - 0.25f * extent.y, center.z),
+            vector3(center.x, bounds.max.y + 0.25f * extent.y, center.z),
+            vector3(center.x + 0.5f * extent.x, bounds.max.y + 0.25f * extent.y, center.z + 0.5f * extent.z),
+            vector3(center.x, bounds.max.y + 2.0f * extent.y, center.z),
+        };
+
+        constexpr size_t SAMPLES = 1024;
+        const size_t stride = std::max<size_t>(1, origins.size() / SAMPLES);
+        vector3 light = candidates[0];
+        double best = 2.0;
+        for (const vector3& candidate : candidates)
+        {
+            size_t blocked = 0, tested = 0;
+            for (size_t i = 0; i < origins.size(); i += stride, tested++)
+                if (const shadow_ray sr = towards(origins[i], candidate); s.occluded(sr.r, sr.t_max)) blocked++;
+            const double off = std::fabs(static_cast<double>(blocked) / std::max<size_t>(tested, 1) - 0.5);
+            if (off < best)
+            {
+                best = off;
+                light = candidate;
+            }
+        }
+
+        std::vector<shadow_ray> shadow_rays;
+        shadow_rays.reserve(origins.size());
+        for (const vector3& origin : origins)
+            if ((light - origin).length_2() > 0.0f) shadow_rays.push_back(towards(origin, light));
+        return shadow_rays;
+    }
+
+    // stops just short of the light, so a surface at it does not count as a blocker
+    static shadow_ray towards(const vector3& origin, const vector3& light)
+    {
+        const vector3 to_light = light - origin;
+        const float distance = to_light.length();
+        return {ray(origin, to_light * (1.0f / distance)), distance * (1.0f - 1e-3f)};
+    }
+};
+
+#endif // RAY_TRACER_TRAVERSAL_BENCHMARK
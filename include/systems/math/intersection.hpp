@@ -8,7 +8,9 @@
 #define RAY_TRACER_INTERSECTION_SYSTEM
 
 #include "components/geometry/sphere.hpp"
+#include "components/math/aabb.hpp"
 #include "components/geometry/triangle.hpp"
+#include "components/geometry/triangle_record.hpp"
 #include "components/math/ray.hpp"
 #include "components/math/vector3.hpp"
 #include "components/math/intersection.hpp"
@@ -21,8 +23,30 @@ constexpr float MIN_T = 1e-4f;
 // Small epsilon for front/back face test
 constexpr float FACE_EPS = 1e-5f;
 
-// ---------------------- Sphere Intersection ----------------------
-inline bool intersect(const ray& r, const sphere& s, intersection& i)
+// Rays this close to a triangle's plane count as parallel to it: the Möller–Trumbore determinant a
+// is at most PARALLEL_EPS |direction| |edge1| |edge2|. Relative, so it holds the same for triangles
+// of any size and for the unnormalised object space rays of scaled instances
+constexpr float PARALLEL_EPS = 1e-7f;
+
+// PARALLEL_EPS^2 |d|^2, the part of the parallel test that only depends on the ray
+inline float parallel_scale(const vector3& d)
+{
+    return PARALLEL_EPS * PARALLEL_EPS * (d.x * d.x + d.y * d.y + d.z * d.z);
+}
+
+// the test compared in squares, with each sum in the order the SIMD kernels take
+inline bool nearly_parallel(const float a, const vector3& d, const vector3& edge1, const vector3& edge2)
+{
+    const float e1_2 = edge1.x * edge1.x + edge1.y * edge1.y + edge1.z * edge1.z;
+    const float e2_2 = edge2.x * edge2.x + edge2.y * edge2.y + edge2.z * edge2.z;
+    return a * a <= parallel_scale(d) * e1_2 * e2_2;
+}
+
+// ---------------------- Hit Distances ----------------------
+// Distance to the nearest hit past MIN_T, without the normal and face work.
+// The closest hit search only needs these; intersect() below adds the rest.
+
+inline bool hit_distance(const ray& r, const sphere& s, float& t)
 {
     // oc = ray origin - sphere center
     const vector3 oc = r.origin - s.center;
@@ -38,9 +62,73 @@ inline bool intersect(const ray& r, const sphere& s, intersection& i)
     const float sqrt_disc = std::sqrt(disc);
 
     // Pick nearest positive root
-    float t = (-half_b - sqrt_disc) / a;
+    t = (-half_b - sqrt_disc) / a;
     if (t < MIN_T) t = (-half_b + sqrt_disc) / a;
-    if (t < MIN_T) return false;
+    return t >= MIN_T;
+}
+
+// u and v receive the barycentrics of v1 and v2 at the hit
+inline bool hit_distance(const ray& r, const triangle& tri, float& t, float& u, float& v)
+{
+    const vector3 edge1 = tri.v1 - tri.v0;
+    const vector3 edge2 = tri.v2 - tri.v0;
+
+    const vector3 h = vector3::cross(r.direction, edge2);
+    const float a = vector3::dot(edge1, h);
+
+    if (nearly_parallel(a, r.direction, edge1, edge2)) return false;
+
+    const float f = 1.0f / a;
+    const vector3 s = r.origin - tri.v0;
+    u = f * vector3::dot(s, h);
+    if (u < 0.0f || u > 1.0f) return false;
+
+    const vector3 q = vector3::cross(s, edge1);
+    v = f * vector3::dot(r.direction, q);
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    t = f * vector3::dot(edge2, q);
+    return t >= MIN_T;
+}
+
+inline bool hit_distance(const ray& r, const triangle& tri, float& t)
+{
+    float u, v;
+    return hit_distance(r, tri, t, u, v);
+}
+
+// same test with the edges precomputed
+inline bool hit_distance(const ray& r, const triangle_record& tri, float& t, float& u, float& v)
+{
+    const vector3 h = vector3::cross(r.direction, tri.edge2);
+    const float a = vector3::dot(tri.edge1, h);
+
+    if (nearly_parallel(a, r.direction, tri.edge1, tri.edge2)) return false;
+
+    const float f = 1.0f / a;
+    const vector3 s = r.origin - tri.v0;
+    u = f * vector3::dot(s, h);
+    if (u < 0.0f || u > 1.0f) return false;
+
+    const vector3 q = vector3::cross(s, tri.edge1);
+    v = f * vector3::dot(r.direction, q);
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    t = f * vector3::dot(tri.edge2, q);
+    return t >= MIN_T;
+}
+
+inline bool hit_distance(const ray& r, const triangle_record& tri, float& t)
+{
+    float u, v;
+    return hit_distance(r, tri, t, u, v);
+}
+
+// ---------------------- Sphere Intersection ----------------------
+inline bool intersect(const ray& r, const sphere& s, intersection& i)
+{
+    float t;
+    if (!hit_distance(r, s, t)) return false;
 
     i.intersection_distance = t;
 
@@ -65,30 +153,13 @@ inline bool intersect(const ray& r, const sphere& s, intersection& i)
 // ---------------------- Triangle Intersection ----------------------
 inline bool intersect(const ray& r, const triangle& tri, intersection& i)
 {
-    vector3 edge1 = tri.v1 - tri.v0;
-    vector3 edge2 = tri.v2 - tri.v0;
-
-    vector3 h = vector3::cross(r.direction, edge2);
-    float a = vector3::dot(edge1, h);
-
-    if (std::fabs(a) < MIN_T) return false; // ray parallel
-
-    float f = 1.0f / a;
-    vector3 s = r.origin - tri.v0;
-    float u = f * vector3::dot(s, h);
-    if (u < 0.0f || u > 1.0f) return false;
-
-    vector3 q = vector3::cross(s, edge1);
-    float v = f * vector3::dot(r.direction, q);
-    if (v < 0.0f || u + v > 1.0f) return false;
-
-    float t = f * vector3::dot(edge2, q);
-    if (t < MIN_T) return false;
+    float t;
+    if (!hit_distance(r, tri, t)) return false;
 
     i.intersection_distance = t;
 
     // Compute outward normal
-    vector3 outward = vector3::cross(edge1, edge2).normalized();
+    vector3 outward = vector3::cross(tri.v1 - tri.v0, tri.v2 - tri.v0).normalized();
 
     // Front/back test
     float cosr = vector3::dot(r.direction, outward);
@@ -103,4 +174,61 @@ inline bool intersect(const ray& r, const triangle& tri, intersection& i)
     return true;
 }
 
+// ---------------------- Triangle Record Intersection ----------------------
+// Same result as testing the triangle the record was built from, with the
+// edges and the normal read instead of recomputed.
+inline bool intersect(const ray& r, const triangle_record& tri, intersection& i)
+{
+    float t;
+    if (!hit_distance(r, tri, t)) return false;
+
+    i.intersection_distance = t;
+
+    if (vector3::dot(r.direction, tri.normal) > FACE_EPS) {
+        i.back_face = true;
+        i.normal = -tri.normal;
+    } else {
+        i.back_face = false;
+        i.normal = tri.normal;
+    }
+
+    return true;
+}
+
+// ---------------------- Any-hit (occlusion) tests ----------------------
+// True when the ray hits the shape somewhere in [MIN_T, t_max), for visibility queries.
+template <typename Shape>
+inline bool occludes(const ray& r, const Shape& shape, const float t_max)
+{
+    float t;
+    return hit_distance(r, shape, t) && t < t_max;
+}
+
+// ---------------------- Box (slab) Intersection ----------------------
+// inv_dir is 1/direction, computed once per ray by the caller.
+// t_near receives the entry distance, clamped to 0 for rays starting inside.
+inline bool intersect(const ray& r, const vector3& inv_dir, const packed_aabb& box, const float t_max, float& t_near)
+{
+    const float tx1 = (box.min.x - r.origin.x) * inv_dir.x;
+    const float tx2 = (box.max.x - r.origin.x) * inv_dir.x;
+    float t0 = std::min(tx1, tx2);
+    float t1 = std::max(tx1, tx2);
+
+    const float ty1 = (box.min.y - r.origin.y) * inv_dir.y;
+    const float ty2 = (box.max.y - r.origin.y) * inv_dir.y;
+    t0 = std::max(t0, std::min(ty1, ty2));
+    t1 = std::min(t1, std::max(ty1, ty2));
+
+    const float tz1 = (box.min.z - r.origin.z) * inv_dir.z;
+    const float tz2 = (box.max.z - r.origin.z) * inv_dir.z;
+    t0 = std::max(t0, std::min(tz1, tz2));
+    t1 = std::min(t1, std::max(tz1, tz2));
+
+    t0 = std::max(t0, 0.0f);
+    if (t1 < t0 || t0 > t_max) return false;
+
+    t_near = t0;
+    return true;
+}
+
 #endif // RAY_TRACER_INTERSECTION_SYSTEM
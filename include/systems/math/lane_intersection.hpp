@@ -0,0 +1,450 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - lane_intersection.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_LANE_INTERSECTION
+#define RAY_TRACER_LANE_INTERSECTION
+
+#include <cstdint>
+
+#include "systems/platform/cpu_features.hpp"
+
+#if RAY_TRACER_X86
+#include <immintrin.h>
+#endif
+
+#include "components/geometry/triangle.hpp"
+#include "components/geometry/triangle_record.hpp"
+#include "components/math/ray.hpp"
+#include "components/rendering/render_settings.hpp"
+#include "components/scene/primitive_store.hpp"
+#include "systems/math/intersection.hpp"
+
+// One ray against up to 8 primitives of one type in consecutive slots
+// [first, first+count) of their lanes, a primitive per SIMD lane. Returns the
+// lane of the nearest hit closer than t_max and shrinks t_max to it, or -1;
+// the triangle kernels also hand back the barycentrics of that hit.
+// Every version keeps the math of the single primitive hit_distance, so they
+// find the same primitive at the same distance; ties go to the lower lane.
+// Normals are left to surface_interaction on whichever primitive wins.
+// The SIMD versions are built for their instruction set level whatever the
+// compiler flags, intersect_triangles / intersect_spheres pick one at run time.
+
+// the lowest lane of mask with the smallest t, as the scalar loop would pick it
+inline int nearest_lane(uint32_t mask, const float* t, float& t_max)
+{
+    int nearest = -1;
+    for (; mask; mask &= mask - 1)
+    {
+        const int lane = __builtin_ctz(mask);
+        if (t[lane] < t_max)
+        {
+            t_max = t[lane];
+            nearest = lane;
+        }
+    }
+    return nearest;
+}
+
+// ---------------------- Triangles (Möller–Trumbore) ----------------------
+// l is primitive_store::triangle_lanes or a triangle_batch
+
+// up to 8 triangles copied into lanes from elsewhere, e.g. mesh triangles gathered
+// through their index buffer, so they can go through the same kernels
+struct triangle_batch
+{
+    alignas(32) float v0x[8], v0y[8], v0z[8];
+    alignas(32) float e1x[8], e1y[8], e1z[8];
+    alignas(32) float e2x[8], e2y[8], e2z[8];
+
+    void set(const int i, const triangle& t)
+    {
+        const vector3 edge1 = t.v1 - t.v0, edge2 = t.v2 - t.v0;
+        v0x[i] = t.v0.x; v0y[i] = t.v0.y; v0z[i] = t.v0.z;
+        e1x[i] = edge1.x; e1y[i] = edge1.y; e1z[i] = edge1.z;
+        e2x[i] = edge2.x; e2y[i] = edge2.y; e2z[i] = edge2.z;
+    }
+
+    // every lane can be loaded, the kernels mask off the ones past count
+    [[nodiscard]] static size_t size() { return 8; }
+
+    // the normal is left out, hit_distance does not read it
+    [[nodiscard]] triangle_record at(const uint32_t i) const
+    {
+        triangle_record t;
+        t.v0 = {v0x[i], v0y[i], v0z[i]};
+        t.edge1 = {e1x[i], e1y[i], e1z[i]};
+        t.edge2 = {e2x[i], e2y[i], e2z[i]};
+        return t;
+    }
+};
+
+template <typename Lanes>
+inline int intersect_triangles_scalar(const Lanes& l, const uint32_t first, const int count, const ray& r, float& t_max,
+                                      float& u, float& v)
+{
+    int nearest = -1;
+    for (int i = 0; i < count; i++)
+    {
+        if (float t, hit_u, hit_v; hit_distance(r, l.at(first + i), t, hit_u, hit_v) && t < t_max)
+        {
+            t_max = t;
+            u = hit_u;
+            v = hit_v;
+            nearest = i;
+        }
+    }
+    return nearest;
+}
+
+#if RAY_TRACER_X86
+// two groups of 4; reads whole groups, so slots up to first+8 must exist
+template <typename Lanes>
+RAY_TRACER_TARGET_SSE42 inline int intersect_triangles_sse(const Lanes& l, const uint32_t first, const int count,
+                                                           const ray& r, float& t_max, float& u, float& v)
+{
+    const __m128 ox = _mm_set1_ps(r.origin.x), oy = _mm_set1_ps(r.origin.y), oz = _mm_set1_ps(r.origin.z);
+    const __m128 dx = _mm_set1_ps(r.direction.x), dy = _mm_set1_ps(r.direction.y), dz = _mm_set1_ps(r.direction.z);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), min_t = _mm_set1_ps(MIN_T), limit = _mm_set1_ps(t_max);
+    const __m128 scale = _mm_set1_ps(parallel_scale(r.direction));
+
+    alignas(16) float t[8], bary_u[8], bary_v[8];
+    uint32_t mask = 0;
+    for (int g = 0; g < count; g += 4)
+    {
+        const uint32_t i = first + g;
+        const __m128 e1x = _mm_loadu_ps(&l.e1x[i]), e1y = _mm_loadu_ps(&l.e1y[i]), e1z = _mm_loadu_ps(&l.e1z[i]);
+        const __m128 e2x = _mm_loadu_ps(&l.e2x[i]), e2y = _mm_loadu_ps(&l.e2y[i]), e2z = _mm_loadu_ps(&l.e2z[i]);
+
+        // h = d x edge2
+        const __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+
+        // not nearly_parallel
+        const __m128 e1_2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, e1x), _mm_mul_ps(e1y, e1y)), _mm_mul_ps(e1z, e1z));
+        const __m128 e2_2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, e2x), _mm_mul_ps(e2y, e2y)), _mm_mul_ps(e2z, e2z));
+        __m128 hit = _mm_cmpnle_ps(_mm_mul_ps(a, a), _mm_mul_ps(_mm_mul_ps(scale, e1_2), e2_2));
+
+        const __m128 f = _mm_div_ps(one, a);
+        const __m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(&l.v0x[i]));
+        const __m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(&l.v0y[i]));
+        const __m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(&l.v0z[i]));
+        const __m128 bu = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(bu, zero), _mm_cmple_ps(bu, one)));
+
+        // q = s x edge1
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        const __m128 bv = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(bv, zero), _mm_cmple_ps(_mm_add_ps(bu, bv), one)));
+
+        const __m128 tt = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(tt, min_t), _mm_cmplt_ps(tt, limit)));
+
+        _mm_store_ps(t + g, tt);
+        _mm_store_ps(bary_u + g, bu);
+        _mm_store_ps(bary_v + g, bv);
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << g;
+    }
+
+    const int nearest = nearest_lane(mask & ((1u << count) - 1u), t, t_max);
+    if (nearest >= 0)
+    {
+        u = bary_u[nearest];
+        v = bary_v[nearest];
+    }
+    return nearest;
+}
+
+// all 8 lanes at once; reads slots up to first+8, which must exist
+template <typename Lanes>
+RAY_TRACER_TARGET_AVX2 inline int intersect_triangles_avx2(const Lanes& l, const uint32_t first, const int count,
+                                                           const ray& r, float& t_max, float& u, float& v)
+{
+    const __m256 ox = _mm256_set1_ps(r.origin.x), oy = _mm256_set1_ps(r.origin.y), oz = _mm256_set1_ps(r.origin.z);
+    const __m256 dx = _mm256_set1_ps(r.direction.x), dy = _mm256_set1_ps(r.direction.y), dz = _mm256_set1_ps(r.direction.z);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), min_t = _mm256_set1_ps(MIN_T);
+    const __m256 scale = _mm256_set1_ps(parallel_scale(r.direction));
+
+    const __m256 e1x = _mm256_loadu_ps(&l.e1x[first]), e1y = _mm256_loadu_ps(&l.e1y[first]), e1z = _mm256_loadu_ps(&l.e1z[first]);
+    const __m256 e2x = _mm256_loadu_ps(&l.e2x[first]), e2y = _mm256_loadu_ps(&l.e2y[first]), e2z = _mm256_loadu_ps(&l.e2z[first]);
+
+    // h = d x edge2
+    const __m256 hx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    const __m256 hy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    const __m256 hz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    const __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, hx), _mm256_mul_ps(e1y, hy)), _mm256_mul_ps(e1z, hz));
+
+    // not nearly_parallel
+    const __m256 e1_2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, e1x), _mm256_mul_ps(e1y, e1y)), _mm256_mul_ps(e1z, e1z));
+    const __m256 e2_2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, e2x), _mm256_mul_ps(e2y, e2y)), _mm256_mul_ps(e2z, e2z));
+    __m256 hit = _mm256_cmp_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(_mm256_mul_ps(scale, e1_2), e2_2), _CMP_NLE_UQ);
+
+    const __m256 f = _mm256_div_ps(one, a);
+    const __m256 sx = _mm256_sub_ps(ox, _mm256_loadu_ps(&l.v0x[first]));
+    const __m256 sy = _mm256_sub_ps(oy, _mm256_loadu_ps(&l.v0y[first]));
+    const __m256 sz = _mm256_sub_ps(oz, _mm256_loadu_ps(&l.v0z[first]));
+    const __m256 bu = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, hx), _mm256_mul_ps(sy, hy)), _mm256_mul_ps(sz, hz)));
+    hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(bu, zero, _CMP_GE_OQ), _mm256_cmp_ps(bu, one, _CMP_LE_OQ)));
+
+    // q = s x edge1
+    const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    const __m256 bv = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+    hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(bv, zero, _CMP_GE_OQ),
+                                           _mm256_cmp_ps(_mm256_add_ps(bu, bv), one, _CMP_LE_OQ)));
+
+    const __m256 tt = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)));
+    hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(tt, min_t, _CMP_GE_OQ),
+                                           _mm256_cmp_ps(tt, _mm256_set1_ps(t_max), _CMP_LT_OQ)));
+
+    alignas(32) float t[8], bary_u[8], bary_v[8];
+    _mm256_store_ps(t, tt);
+    _mm256_store_ps(bary_u, bu);
+    _mm256_store_ps(bary_v, bv);
+
+    const int nearest = nearest_lane(static_cast<uint32_t>(_mm256_movemask_ps(hit)) & ((1u << count) - 1u), t, t_max);
+    if (nearest >= 0)
+    {
+        u = bary_u[nearest];
+        v = bary_v[nearest];
+    }
+    return nearest;
+}
+
+// the AVX2 math with the tests accumulated in a mask register, which also
+// lets it stop once no lane is left after the u test
+template <typename Lanes>
+RAY_TRACER_TARGET_AVX512 inline int intersect_triangles_avx512(const Lanes& l, const uint32_t first, const int count,
+                                                               const ray& r, float& t_max, float& u, float& v)
+{
+    const __m256 ox = _mm256_set1_ps(r.origin.x), oy = _mm256_set1_ps(r.origin.y), oz = _mm256_set1_ps(r.origin.z);
+    const __m256 dx = _mm256_set1_ps(r.direction.x), dy = _mm256_set1_ps(r.direction.y), dz = _mm256_set1_ps(r.direction.z);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), min_t = _mm256_set1_ps(MIN_T);
+    const __m256 scale = _mm256_set1_ps(parallel_scale(r.direction));
+
+    const __m256 e1x = _mm256_loadu_ps(&l.e1x[first]), e1y = _mm256_loadu_ps(&l.e1y[first]), e1z = _mm256_loadu_ps(&l.e1z[first]);
+    const __m256 e2x = _mm256_loadu_ps(&l.e2x[first]), e2y = _mm256_loadu_ps(&l.e2y[first]), e2z = _mm256_loadu_ps(&l.e2z[first]);
+
+    // h = d x edge2
+    const __m256 hx = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    const __m256 hy = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    const __m256 hz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    const __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, hx), _mm256_mul_ps(e1y, hy)), _mm256_mul_ps(e1z, hz));
+
+    // not nearly_parallel
+    const __m256 e1_2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, e1x), _mm256_mul_ps(e1y, e1y)), _mm256_mul_ps(e1z, e1z));
+    const __m256 e2_2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, e2x), _mm256_mul_ps(e2y, e2y)), _mm256_mul_ps(e2z, e2z));
+    __mmask8 hit = _mm256_cmp_ps_mask(_mm256_mul_ps(a, a), _mm256_mul_ps(_mm256_mul_ps(scale, e1_2), e2_2), _CMP_NLE_UQ)
+                 & ((1u << count) - 1u);
+
+    const __m256 f = _mm256_div_ps(one, a);
+    const __m256 sx = _mm256_sub_ps(ox, _mm256_loadu_ps(&l.v0x[first]));
+    const __m256 sy = _mm256_sub_ps(oy, _mm256_loadu_ps(&l.v0y[first]));
+    const __m256 sz = _mm256_sub_ps(oz, _mm256_loadu_ps(&l.v0z[first]));
+    const __m256 bu = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, hx), _mm256_mul_ps(sy, hy)), _mm256_mul_ps(sz, hz)));
+    hit = _mm256_mask_cmp_ps_mask(hit, bu, zero, _CMP_GE_OQ);
+    hit = _mm256_mask_cmp_ps_mask(hit, bu, one, _CMP_LE_OQ);
+    if (!hit) return -1;
+
+    // q = s x edge1
+    const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    const __m256 bv = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)));
+    hit = _mm256_mask_cmp_ps_mask(hit, bv, zero, _CMP_GE_OQ);
+    hit = _mm256_mask_cmp_ps_mask(hit, _mm256_add_ps(bu, bv), one, _CMP_LE_OQ);
+
+    const __m256 tt = _mm256_mul_ps(f, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)));
+    hit = _mm256_mask_cmp_ps_mask(hit, tt, min_t, _CMP_GE_OQ);
+    hit = _mm256_mask_cmp_ps_mask(hit, tt, _mm256_set1_ps(t_max), _CMP_LT_OQ);
+    if (!hit) return -1;
+
+    alignas(32) float t[8], bary_u[8], bary_v[8];
+    _mm256_store_ps(t, tt);
+    _mm256_store_ps(bary_u, bu);
+    _mm256_store_ps(bary_v, bv);
+
+    const int nearest = nearest_lane(hit, t, t_max);
+    if (nearest >= 0)
+    {
+        u = bary_u[nearest];
+        v = bary_v[nearest];
+    }
+    return nearest;
+}
+#endif
+
+// picks the kernel of render_settings::kernel_isa; a run too close to the end
+// of the lanes for whole-register loads goes through the scalar loop
+template <typename Lanes>
+inline int intersect_triangles(const Lanes& l, const uint32_t first, const int count, const ray& r, float& t_max,
+                               float& u, float& v)
+{
+#if RAY_TRACER_X86
+    if (first + 8 <= l.size())
+        switch (render_settings::global_settings.kernel_isa)
+        {
+            case isa::avx512: return intersect_triangles_avx512(l, first, count, r, t_max, u, v);
+            case isa::avx2: return intersect_triangles_avx2(l, first, count, r, t_max, u, v);
+            case isa::sse42: return intersect_triangles_sse(l, first, count, r, t_max, u, v);
+            case isa::scalar: break;
+        }
+#endif
+    return intersect_triangles_scalar(l, first, count, r, t_max, u, v);
+}
+
+// ---------------------- Spheres ----------------------
+// a cluster of particles in one leaf costs one sqrt per 4 or 8 spheres and no normal
+inline int intersect_spheres_scalar(const primitive_store::sphere_lanes& l, const uint32_t first, const int count,
+                                    const ray& r, float& t_max)
+{
+    int nearest = -1;
+    for (int i = 0; i < count; i++)
+    {
+        if (float t; hit_distance(r, l.at(first + i), t) && t < t_max)
+        {
+            t_max = t;
+            nearest = i;
+        }
+    }
+    return nearest;
+}
+
+#if RAY_TRACER_X86
+RAY_TRACER_TARGET_SSE42 inline int intersect_spheres_sse(const primitive_store::sphere_lanes& l, const uint32_t first,
+                                                         const int count, const ray& r, float& t_max)
+{
+    const __m128 ox = _mm_set1_ps(r.origin.x), oy = _mm_set1_ps(r.origin.y), oz = _mm_set1_ps(r.origin.z);
+    const __m128 dx = _mm_set1_ps(r.direction.x), dy = _mm_set1_ps(r.direction.y), dz = _mm_set1_ps(r.direction.z);
+    const __m128 a = _mm_set1_ps(vector3::dot(r.direction, r.direction));
+    const __m128 zero = _mm_setzero_ps(), min_t = _mm_set1_ps(MIN_T), limit = _mm_set1_ps(t_max);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    alignas(16) float t[8];
+    uint32_t mask = 0;
+    for (int g = 0; g < count; g += 4)
+    {
+        const uint32_t i = first + g;
+
+        // oc = ray origin - sphere center
+        const __m128 ocx = _mm_sub_ps(ox, _mm_loadu_ps(&l.cx[i]));
+        const __m128 ocy = _mm_sub_ps(oy, _mm_loadu_ps(&l.cy[i]));
+        const __m128 ocz = _mm_sub_ps(oz, _mm_loadu_ps(&l.cz[i]));
+        const __m128 radius = _mm_loadu_ps(&l.radius[i]);
+
+        const __m128 half_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+        const __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+                                    _mm_mul_ps(radius, radius));
+        const __m128 disc = _mm_sub_ps(_mm_mul_ps(half_b, half_b), _mm_mul_ps(a, c));
+        __m128 hit = _mm_cmpge_ps(disc, zero);
+        if (!_mm_movemask_ps(hit)) continue;
+
+        // nearest root, the far one where the near one is behind the origin
+        const __m128 sqrt_disc = _mm_sqrt_ps(disc);
+        const __m128 neg_half_b = _mm_xor_ps(half_b, sign);
+        const __m128 t_near = _mm_div_ps(_mm_sub_ps(neg_half_b, sqrt_disc), a);
+        const __m128 t_far = _mm_div_ps(_mm_add_ps(neg_half_b, sqrt_disc), a);
+        const __m128 behind = _mm_cmplt_ps(t_near, min_t);
+        const __m128 tt = _mm_blendv_ps(t_near, t_far, behind);
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(tt, min_t), _mm_cmplt_ps(tt, limit)));
+
+        _mm_store_ps(t + g, tt);
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << g;
+    }
+    return nearest_lane(mask & ((1u << count) - 1u), t, t_max);
+}
+
+RAY_TRACER_TARGET_AVX2 inline int intersect_spheres_avx2(const primitive_store::sphere_lanes& l, const uint32_t first,
+                                                         const int count, const ray& r, float& t_max)
+{
+    const __m256 ox = _mm256_set1_ps(r.origin.x), oy = _mm256_set1_ps(r.origin.y), oz = _mm256_set1_ps(r.origin.z);
+    const __m256 dx = _mm256_set1_ps(r.direction.x), dy = _mm256_set1_ps(r.direction.y), dz = _mm256_set1_ps(r.direction.z);
+    const __m256 a = _mm256_set1_ps(vector3::dot(r.direction, r.direction));
+    const __m256 zero = _mm256_setzero_ps(), min_t = _mm256_set1_ps(MIN_T);
+
+    const __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(&l.cx[first]));
+    const __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(&l.cy[first]));
+    const __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(&l.cz[first]));
+    const __m256 radius = _mm256_loadu_ps(&l.radius[first]);
+
+    const __m256 half_b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+    const __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)),
+                                   _mm256_mul_ps(radius, radius));
+    const __m256 disc = _mm256_sub_ps(_mm256_mul_ps(half_b, half_b), _mm256_mul_ps(a, c));
+    __m256 hit = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+    if (!_mm256_movemask_ps(hit)) return -1;
+
+    const __m256 sqrt_disc = _mm256_sqrt_ps(disc);
+    const __m256 neg_half_b = _mm256_xor_ps(half_b, _mm256_set1_ps(-0.0f));
+    const __m256 t_near = _mm256_div_ps(_mm256_sub_ps(neg_half_b, sqrt_disc), a);
+    const __m256 t_far = _mm256_div_ps(_mm256_add_ps(neg_half_b, sqrt_disc), a);
+    const __m256 tt = _mm256_blendv_ps(t_near, t_far, _mm256_cmp_ps(t_near, min_t, _CMP_LT_OQ));
+    hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(tt, min_t, _CMP_GE_OQ),
+                                           _mm256_cmp_ps(tt, _mm256_set1_ps(t_max), _CMP_LT_OQ)));
+
+    alignas(32) float t[8];
+    _mm256_store_ps(t, tt);
+    return nearest_lane(static_cast<uint32_t>(_mm256_movemask_ps(hit)) & ((1u << count) - 1u), t, t_max);
+}
+
+RAY_TRACER_TARGET_AVX512 inline int intersect_spheres_avx512(const primitive_store::sphere_lanes& l, const uint32_t first,
+                                                             const int count, const ray& r, float& t_max)
+{
+    const __m256 ox = _mm256_set1_ps(r.origin.x), oy = _mm256_set1_ps(r.origin.y), oz = _mm256_set1_ps(r.origin.z);
+    const __m256 dx = _mm256_set1_ps(r.direction.x), dy = _mm256_set1_ps(r.direction.y), dz = _mm256_set1_ps(r.direction.z);
+    const __m256 a = _mm256_set1_ps(vector3::dot(r.direction, r.direction));
+    const __m256 zero = _mm256_setzero_ps(), min_t = _mm256_set1_ps(MIN_T);
+
+    const __m256 ocx = _mm256_sub_ps(ox, _mm256_loadu_ps(&l.cx[first]));
+    const __m256 ocy = _mm256_sub_ps(oy, _mm256_loadu_ps(&l.cy[first]));
+    const __m256 ocz = _mm256_sub_ps(oz, _mm256_loadu_ps(&l.cz[first]));
+    const __m256 radius = _mm256_loadu_ps(&l.radius[first]);
+
+    const __m256 half_b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, dx), _mm256_mul_ps(ocy, dy)), _mm256_mul_ps(ocz, dz));
+    const __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)), _mm256_mul_ps(ocz, ocz)),
+                                   _mm256_mul_ps(radius, radius));
+    const __m256 disc = _mm256_sub_ps(_mm256_mul_ps(half_b, half_b), _mm256_mul_ps(a, c));
+    __mmask8 hit = _mm256_cmp_ps_mask(disc, zero, _CMP_GE_OQ) & ((1u << count) - 1u);
+    if (!hit) return -1;
+
+    const __m256 sqrt_disc = _mm256_sqrt_ps(disc);
+    const __m256 neg_half_b = _mm256_xor_ps(half_b, _mm256_set1_ps(-0.0f));
+    const __m256 t_near = _mm256_div_ps(_mm256_sub_ps(neg_half_b, sqrt_disc), a);
+    const __m256 t_far = _mm256_div_ps(_mm256_add_ps(neg_half_b, sqrt_disc), a);
+    const __m256 tt = _mm256_mask_blend_ps(_mm256_cmp_ps_mask(t_near, min_t, _CMP_LT_OQ), t_near, t_far);
+    hit = _mm256_mask_cmp_ps_mask(hit, tt, min_t, _CMP_GE_OQ);
+    hit = _mm256_mask_cmp_ps_mask(hit, tt, _mm256_set1_ps(t_max), _CMP_LT_OQ);
+    if (!hit) return -1;
+
+    alignas(32) float t[8];
+    _mm256_store_ps(t, tt);
+    return nearest_lane(hit, t, t_max);
+}
+#endif
+
+inline int intersect_spheres(const primitive_store::sphere_lanes& l, const uint32_t first, const int count,
+                             const ray& r, float& t_max)
+{
+#if RAY_TRACER_X86
+    if (first + 8 <= l.size())
+        switch (render_settings::global_settings.kernel_isa)
+        {
+            case isa::avx512: return intersect_spheres_avx512(l, first, count, r, t_max);
+            case isa::avx2: return intersect_spheres_avx2(l, first, count, r, t_max);
+            case isa::sse42: return intersect_spheres_sse(l, first, count, r, t_max);
+            case isa::scalar: break;
+        }
+#endif
+    return intersect_spheres_scalar(l, first, count, r, t_max);
+}
+
+#endif // RAY_TRACER_LANE_INTERSECTION
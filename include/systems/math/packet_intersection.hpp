@@ -0,0 +1,233 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - packet_intersection.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_PACKET_INTERSECTION
+#define RAY_TRACER_PACKET_INTERSECTION
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#include "components/geometry/sphere.hpp"
+#include "components/geometry/triangle.hpp"
+#include "components/geometry/triangle_record.hpp"
+#include "components/math/aabb.hpp"
+#include "components/math/ray_packet.hpp"
+#include "systems/math/intersection.hpp"
+
+// Packet versions of the tests in intersection.hpp, 4 rays per SSE register.
+// They only look at the lanes set in active and return a bit per lane hit.
+// The primitive tests keep the math of the single ray tests, so a ray finds
+// the same distance either way, and record hits closer than the lane's t_max
+// in t_max, prim and (for triangles) u, v. Normals are left to the surface
+// step on the winner.
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+// ---------------------- Box (slab) Intersection ----------------------
+template <int N>
+inline uint32_t intersect_packet(const ray_packet<N>& p, const packed_aabb& box, const uint32_t active)
+{
+    const __m128 min_x = _mm_set1_ps(box.min.x), min_y = _mm_set1_ps(box.min.y), min_z = _mm_set1_ps(box.min.z);
+    const __m128 max_x = _mm_set1_ps(box.max.x), max_y = _mm_set1_ps(box.max.y), max_z = _mm_set1_ps(box.max.z);
+
+    uint32_t mask = 0;
+    for (int g = 0; g < N; g += 4)
+    {
+        if (!(active >> g & 0xFu)) continue;
+
+        const __m128 ox = _mm_load_ps(p.ox + g), oy = _mm_load_ps(p.oy + g), oz = _mm_load_ps(p.oz + g);
+        const __m128 ix = _mm_load_ps(p.ix + g), iy = _mm_load_ps(p.iy + g), iz = _mm_load_ps(p.iz + g);
+
+        const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(min_x, ox), ix), tx2 = _mm_mul_ps(_mm_sub_ps(max_x, ox), ix);
+        const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(min_y, oy), iy), ty2 = _mm_mul_ps(_mm_sub_ps(max_y, oy), iy);
+        const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(min_z, oz), iz), tz2 = _mm_mul_ps(_mm_sub_ps(max_z, oz), iz);
+
+        const __m128 t0 = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+                                     _mm_max_ps(_mm_min_ps(tz1, tz2), _mm_setzero_ps()));
+        const __m128 t1 = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)),
+                                     _mm_min_ps(_mm_max_ps(tz1, tz2), _mm_load_ps(p.t_max + g)));
+
+        mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(t0, t1))) << g;
+    }
+    return mask & active;
+}
+
+// stores t and the barycentrics u, v into the lanes of hit that beat their t_max
+template <int N>
+inline uint32_t record_packet_hits(ray_packet<N>& p, const int g, const __m128 t, const __m128 hit, const uint32_t prim,
+                                   const __m128 u = _mm_setzero_ps(), const __m128 v = _mm_setzero_ps())
+{
+    const __m128 closer = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_load_ps(p.t_max + g)));
+    const uint32_t lanes = _mm_movemask_ps(closer);
+    if (!lanes) return 0;
+
+    _mm_store_ps(p.t_max + g, _mm_or_ps(_mm_and_ps(closer, t), _mm_andnot_ps(closer, _mm_load_ps(p.t_max + g))));
+    _mm_store_ps(p.u + g, _mm_or_ps(_mm_and_ps(closer, u), _mm_andnot_ps(closer, _mm_load_ps(p.u + g))));
+    _mm_store_ps(p.v + g, _mm_or_ps(_mm_and_ps(closer, v), _mm_andnot_ps(closer, _mm_load_ps(p.v + g))));
+    for (uint32_t m = lanes; m; m &= m - 1) p.prim[g + __builtin_ctz(m)] = prim;
+    return lanes << g;
+}
+
+// ---------------------- Sphere Intersection ----------------------
+template <int N>
+inline uint32_t intersect_packet(ray_packet<N>& p, const sphere& s, const uint32_t active, const uint32_t prim)
+{
+    const __m128 cx = _mm_set1_ps(s.center.x), cy = _mm_set1_ps(s.center.y), cz = _mm_set1_ps(s.center.z);
+    const __m128 r2 = _mm_set1_ps(s.radius * s.radius);
+    const __m128 min_t = _mm_set1_ps(MIN_T);
+
+    uint32_t mask = 0;
+    for (int g = 0; g < N; g += 4)
+    {
+        if (!(active >> g & 0xFu)) continue;
+
+        const __m128 dx = _mm_load_ps(p.dx + g), dy = _mm_load_ps(p.dy + g), dz = _mm_load_ps(p.dz + g);
+        const __m128 ocx = _mm_sub_ps(_mm_load_ps(p.ox + g), cx);
+        const __m128 ocy = _mm_sub_ps(_mm_load_ps(p.oy + g), cy);
+        const __m128 ocz = _mm_sub_ps(_mm_load_ps(p.oz + g), cz);
+
+        const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        const __m128 half_b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, dx), _mm_mul_ps(ocy, dy)), _mm_mul_ps(ocz, dz));
+        const __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)), r2);
+
+        const __m128 disc = _mm_sub_ps(_mm_mul_ps(half_b, half_b), _mm_mul_ps(a, c));
+        const __m128 valid = _mm_cmpge_ps(disc, _mm_setzero_ps());
+        if (!_mm_movemask_ps(valid)) continue;
+
+        const __m128 sqrt_disc = _mm_sqrt_ps(_mm_max_ps(disc, _mm_setzero_ps()));
+        const __m128 neg_half_b = _mm_sub_ps(_mm_setzero_ps(), half_b);
+        const __m128 t_near = _mm_div_ps(_mm_sub_ps(neg_half_b, sqrt_disc), a);
+        const __m128 t_far = _mm_div_ps(_mm_add_ps(neg_half_b, sqrt_disc), a);
+
+        // nearest root past MIN_T, like the single ray test
+        const __m128 use_near = _mm_cmpge_ps(t_near, min_t);
+        const __m128 t = _mm_or_ps(_mm_and_ps(use_near, t_near), _mm_andnot_ps(use_near, t_far));
+        const __m128 hit = _mm_and_ps(valid, _mm_cmpge_ps(t, min_t));
+
+        mask |= record_packet_hits(p, g, t, hit, prim);
+    }
+    return mask & active;
+}
+
+// ---------------------- Triangle Intersection ----------------------
+template <int N>
+inline uint32_t intersect_packet(ray_packet<N>& p, const triangle_record& tri, const uint32_t active, const uint32_t prim)
+{
+    const vector3& edge1 = tri.edge1;
+    const vector3& edge2 = tri.edge2;
+    const __m128 e1x = _mm_set1_ps(edge1.x), e1y = _mm_set1_ps(edge1.y), e1z = _mm_set1_ps(edge1.z);
+    const __m128 e2x = _mm_set1_ps(edge2.x), e2y = _mm_set1_ps(edge2.y), e2z = _mm_set1_ps(edge2.z);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 eps_2 = _mm_set1_ps(PARALLEL_EPS * PARALLEL_EPS);
+    const __m128 e1_2 = _mm_set1_ps(edge1.x * edge1.x + edge1.y * edge1.y + edge1.z * edge1.z);
+    const __m128 e2_2 = _mm_set1_ps(edge2.x * edge2.x + edge2.y * edge2.y + edge2.z * edge2.z);
+
+    uint32_t mask = 0;
+    for (int g = 0; g < N; g += 4)
+    {
+        if (!(active >> g & 0xFu)) continue;
+
+        const __m128 dx = _mm_load_ps(p.dx + g), dy = _mm_load_ps(p.dy + g), dz = _mm_load_ps(p.dz + g);
+
+        // h = d x edge2
+        const __m128 hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+
+        // not nearly_parallel, |d| differing per ray
+        const __m128 d_2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        const __m128 scale = _mm_mul_ps(eps_2, d_2);
+        __m128 hit = _mm_cmpnle_ps(_mm_mul_ps(a, a), _mm_mul_ps(_mm_mul_ps(scale, e1_2), e2_2));
+        if (!_mm_movemask_ps(hit)) continue;
+
+        const __m128 f = _mm_div_ps(one, a);
+        const __m128 sx = _mm_sub_ps(_mm_load_ps(p.ox + g), _mm_set1_ps(tri.v0.x));
+        const __m128 sy = _mm_sub_ps(_mm_load_ps(p.oy + g), _mm_set1_ps(tri.v0.y));
+        const __m128 sz = _mm_sub_ps(_mm_load_ps(p.oz + g), _mm_set1_ps(tri.v0.z));
+        const __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+
+        // q = s x edge1
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        const __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+        hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+
+        const __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(t, _mm_set1_ps(MIN_T)));
+
+        mask |= record_packet_hits(p, g, t, hit, prim, u, v);
+    }
+    return mask & active;
+}
+
+// mesh triangles come as plain triangles, only the edges are needed here
+template <int N>
+inline uint32_t intersect_packet(ray_packet<N>& p, const triangle& tri, const uint32_t active, const uint32_t prim)
+{
+    triangle_record edges;
+    edges.v0 = tri.v0;
+    edges.edge1 = tri.v1 - tri.v0;
+    edges.edge2 = tri.v2 - tri.v0;
+    return intersect_packet(p, edges, active, prim);
+}
+
+#else
+
+// one lane at a time through the single ray tests
+template <int N>
+inline uint32_t intersect_packet(const ray_packet<N>& p, const packed_aabb& box, const uint32_t active)
+{
+    uint32_t mask = 0;
+    for (uint32_t m = active; m; m &= m - 1)
+    {
+        const int i = __builtin_ctz(m);
+        ray r;
+        r.origin = vector3(p.ox[i], p.oy[i], p.oz[i]);
+        if (float t_near; intersect(r, vector3(p.ix[i], p.iy[i], p.iz[i]), box, p.t_max[i], t_near)) mask |= 1u << i;
+    }
+    return mask;
+}
+
+template <int N, typename Shape>
+inline uint32_t intersect_packet(ray_packet<N>& p, const Shape& shape, const uint32_t active, const uint32_t prim)
+{
+    uint32_t mask = 0;
+    for (uint32_t m = active; m; m &= m - 1)
+    {
+        const int i = __builtin_ctz(m);
+        ray r;
+        r.origin = vector3(p.ox[i], p.oy[i], p.oz[i]);
+        r.direction = vector3(p.dx[i], p.dy[i], p.dz[i]);
+        float t, u = 0.0f, v = 0.0f;
+        bool hit;
+        if constexpr (std::is_same_v<Shape, sphere>) hit = hit_distance(r, shape, t);
+        else hit = hit_distance(r, shape, t, u, v);
+
+        if (hit && t < p.t_max[i])
+        {
+            p.t_max[i] = t;
+            p.prim[i] = prim;
+            p.u[i] = u;
+            p.v[i] = v;
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+#endif
+
+#endif // RAY_TRACER_PACKET_INTERSECTION
@@ -0,0 +1,191 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - primitive_intersection.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_PRIMITIVE_INTERSECTION
+#define RAY_TRACER_PRIMITIVE_INTERSECTION
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#include "components/math/hit_record.hpp"
+#include "components/math/intersection.hpp"
+#include "components/math/ray.hpp"
+#include "components/math/ray_packet.hpp"
+#include "components/scene/primitive_store.hpp"
+#include "systems/math/intersection.hpp"
+#include "systems/math/lane_intersection.hpp"
+#include "systems/math/packet_intersection.hpp"
+
+// Tests against primitive prim of a primitive_store. The type comes from
+// the ref's top bits, so a test costs a predictable branch or two instead of
+// a std::visit, and only the lanes of that type are read.
+
+// closest hit search: returns true and records prim in h (t and barycentrics) when it is hit before h.t
+inline bool intersect_closer(const primitive_store& ps, const uint32_t prim, const ray& r, hit_record& h)
+{
+    float t, u = 0.0f, v = 0.0f;
+    const bool hit = ps.visit(prim, [&](const auto& shape)
+    {
+        if constexpr (std::is_same_v<std::decay_t<decltype(shape)>, sphere>) return hit_distance(r, shape, t);
+        else return hit_distance(r, shape, t, u, v);
+    });
+    if (!hit || t >= h.t) return false;
+
+    h.t = t;
+    h.prim = prim;
+    h.u = u;
+    h.v = v;
+    return true;
+}
+
+// Copies the run of mesh triangles prims starts with, at most 8 of count, into batch for the wide
+// triangle test and returns how many. Mesh triangles share vertices, so they are gathered through
+// the index buffer instead of read from the lanes.
+inline uint32_t gather_mesh_run(const primitive_store& ps, const uint32_t* prims, const uint32_t count,
+                                triangle_batch& batch)
+{
+    uint32_t n = 0;
+    for (; n < 8 && n < count && primitive_store::is_mesh(ps.refs[prims[n]]); n++)
+        batch.set(static_cast<int>(n), ps.mesh_triangle_at(primitive_store::slot(ps.refs[prims[n]])));
+    return n;
+}
+
+// closest hit search over the count primitives listed in prims, e.g. a BVH leaf: runs of up to 8
+// triangles or spheres in consecutive slots, and of mesh triangles, take one wide test, the rest go
+// one at a time
+inline bool intersect_closer(const primitive_store& ps, const uint32_t* prims, const uint32_t count, const ray& r,
+                             hit_record& h)
+{
+    bool hit = false;
+    for (uint32_t first = 0; first < count;)
+    {
+        if (primitive_store::is_mesh(ps.refs[prims[first]]))
+        {
+            triangle_batch batch;
+            const uint32_t n = gather_mesh_run(ps, prims + first, count - first, batch);
+            if (const int lane = intersect_triangles(batch, 0, static_cast<int>(n), r, h.t, h.u, h.v); lane >= 0)
+            {
+                h.prim = prims[first + lane];
+                hit = true;
+            }
+            first += n;
+            continue;
+        }
+
+        const uint32_t n = ps.lane_run(prims + first, count - first);
+        if (n == 1)
+        {
+            hit |= intersect_closer(ps, prims[first], r, h);
+        }
+        else
+        {
+            const uint32_t ref = ps.refs[prims[first]];
+            int lane;
+            if (primitive_store::is_sphere(ref))
+            {
+                lane = intersect_spheres(ps.spheres, primitive_store::slot(ref), static_cast<int>(n), r, h.t);
+                if (lane >= 0) h.u = h.v = 0.0f;
+            }
+            else lane = intersect_triangles(ps.triangles, ref, static_cast<int>(n), r, h.t, h.u, h.v);
+
+            if (lane >= 0)
+            {
+                h.prim = prims[first + lane];
+                hit = true;
+            }
+        }
+        first += n;
+    }
+    return hit;
+}
+
+inline bool occludes(const primitive_store& ps, const uint32_t prim, const ray& r, const float t_max)
+{
+    return ps.visit(prim, [&](const auto& shape) { return occludes(r, shape, t_max); });
+}
+
+// any hit over the count primitives listed in prims, in the same wide tests as the leaf
+// intersect_closer; true at the first run with a hit before t_max
+inline bool occludes(const primitive_store& ps, const uint32_t* prims, const uint32_t count, const ray& r,
+                     const float t_max)
+{
+    for (uint32_t first = 0; first < count;)
+    {
+        float t = t_max, u, v;
+        if (primitive_store::is_mesh(ps.refs[prims[first]]))
+        {
+            triangle_batch batch;
+            const uint32_t n = gather_mesh_run(ps, prims + first, count - first, batch);
+            if (intersect_triangles(batch, 0, static_cast<int>(n), r, t, u, v) >= 0) return true;
+            first += n;
+            continue;
+        }
+
+        const uint32_t n = ps.lane_run(prims + first, count - first);
+        if (n == 1)
+        {
+            if (occludes(ps, prims[first], r, t_max)) return true;
+        }
+        else
+        {
+            const uint32_t ref = ps.refs[prims[first]];
+            const int lane = primitive_store::is_sphere(ref)
+                ? intersect_spheres(ps.spheres, primitive_store::slot(ref), static_cast<int>(n), r, t)
+                : intersect_triangles(ps.triangles, ref, static_cast<int>(n), r, t, u, v);
+            if (lane >= 0) return true;
+        }
+        first += n;
+    }
+    return false;
+}
+
+// The surface step, run once for the hit a search settled on, with the ray it was found along:
+// position, normal turned to the ray's side (blended from vertex normals on meshes that have them)
+// and uv. Front and back are told apart by the geometric normal, as in the shape tests.
+inline void surface_interaction(const primitive_store& ps, const hit_record& h, const ray& r, intersection& i)
+{
+    i.intersection_distance = h.t;
+    i.position = r.at(h.t);
+
+    const uint32_t ref = ps.refs[h.prim];
+    const uint32_t slot = primitive_store::slot(ref);
+    vector3 geometric, shading;
+    if (primitive_store::is_sphere(ref))
+    {
+        geometric = shading = (i.position - ps.sphere_at(slot).center).normalized();
+
+        // same layout as mesh::uv_sphere: u around the y axis, v from the top pole down
+        const float phi = std::atan2(geometric.z, geometric.x);
+        i.uv = {(phi < 0.0f ? phi + 2.0f * static_cast<float>(M_PI) : phi) / (2.0f * static_cast<float>(M_PI)),
+                std::acos(std::clamp(geometric.y, -1.0f, 1.0f)) / static_cast<float>(M_PI)};
+    }
+    else if (primitive_store::is_mesh(ref))
+    {
+        geometric = ps.mesh_triangle_at(slot).normal();
+        shading = ps.mesh_normal(slot, h.u, h.v);
+        i.uv = ps.mesh_uv(slot, h.u, h.v);
+    }
+    else
+    {
+        geometric = shading = ps.triangle_at(slot).normal;
+        i.uv = {h.u, h.v};
+    }
+
+    i.back_face = vector3::dot(r.direction, geometric) > FACE_EPS;
+    i.normal = i.back_face ? -shading : shading;
+}
+
+template <int N>
+inline uint32_t intersect_packet(ray_packet<N>& p, const primitive_store& ps, const uint32_t active, const uint32_t prim)
+{
+    return ps.visit(prim, [&](const auto& shape) { return intersect_packet(p, shape, active, prim); });
+}
+
+#endif // RAY_TRACER_PRIMITIVE_INTERSECTION
@@ -9,6 +9,7 @@
 #ifndef RAY_TRACER_RANDOM
 #define RAY_TRACER_RANDOM
 
+#include <algorithm>
 #include <cmath>
 #include <random>
 
@@ -65,4 +66,10 @@ inline vector3 random_cosine_hemisphere(const vector3& normal)
     return (u*x + v*y + w*z).normalized();
 }
 
+// density per unit solid angle of random_cosine_hemisphere(normal) returning dir
+inline float cosine_hemisphere_pdf(const vector3& normal, const vector3& dir)
+{
+    return std::max(0.0f, vector3::dot(normal, dir)) / static_cast<float>(M_PI);
+}
+
 #endif //RAY_TRACER_RANDOM
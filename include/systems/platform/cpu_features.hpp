@@ -0,0 +1,111 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - cpu_features.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_CPU_FEATURES
+#define RAY_TRACER_CPU_FEATURES
+
+#include <optional>
+#include <string_view>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+// Instruction set levels the SIMD kernels are built for. Every level is compiled
+// into the same binary, render_settings::kernel_isa picks one at run time.
+enum class isa
+{
+    scalar,
+    sse42,
+    avx2,
+    avx512 // AVX-512 F + VL, used on 256-bit registers with mask compares
+};
+
+// RAY_TRACER_X86 is set where the SIMD kernels exist at all. Their functions carry a
+// RAY_TRACER_TARGET_* attribute so GCC and Clang emit them for that level without
+// -m flags on the whole build; MSVC accepts the intrinsics anywhere and needs none.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RAY_TRACER_X86 1
+#define RAY_TRACER_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define RAY_TRACER_TARGET_AVX2 __attribute__((target("avx2")))
+#define RAY_TRACER_TARGET_AVX512 __attribute__((target("avx512f,avx512vl")))
+#define RAY_TRACER_ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define RAY_TRACER_X86 1
+#define RAY_TRACER_TARGET_SSE42
+#define RAY_TRACER_TARGET_AVX2
+#define RAY_TRACER_TARGET_AVX512
+#define RAY_TRACER_ALWAYS_INLINE __forceinline
+#else
+#define RAY_TRACER_X86 0
+#define RAY_TRACER_ALWAYS_INLINE inline
+#endif
+
+// cpuid (and the OS register state check) for one level
+inline bool isa_supported(const isa level)
+{
+    if (level == isa::scalar) return true;
+#if RAY_TRACER_X86 && (defined(__GNUC__) || defined(__clang__))
+    // may run from static initialisers, before the runtime would have set the feature bits up
+    __builtin_cpu_init();
+    switch (level)
+    {
+        case isa::sse42: return __builtin_cpu_supports("sse4.2");
+        case isa::avx2: return __builtin_cpu_supports("avx2");
+        case isa::avx512: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512f") &&
+                                 __builtin_cpu_supports("avx512vl");
+        default: return false;
+    }
+#elif RAY_TRACER_X86
+    int regs[4];
+    __cpuid(regs, 1);
+    const bool sse42 = regs[2] & (1 << 20);
+    const bool os_avx = (regs[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6; // OSXSAVE, xmm and ymm state
+    const bool os_avx512 = os_avx && (_xgetbv(0) & 0xe0) == 0xe0;          // plus opmask and zmm state
+    __cpuidex(regs, 7, 0);
+    const bool avx2 = os_avx && (regs[1] & (1 << 5));
+    const bool avx512 = avx2 && os_avx512 && (regs[1] & (1 << 16)) && (regs[1] & (1 << 31)); // F, VL
+    switch (level)
+    {
+        case isa::sse42: return sse42;
+        case isa::avx2: return avx2;
+        case isa::avx512: return avx512;
+        default: return false;
+    }
+#else
+    return false;
+#endif
+}
+
+// the widest level this CPU runs
+inline isa detect_isa()
+{
+    for (const isa level : {isa::avx512, isa::avx2, isa::sse42})
+        if (isa_supported(level)) return level;
+    return isa::scalar;
+}
+
+inline const char* isa_name(const isa level)
+{
+    switch (level)
+    {
+        case isa::sse42: return "sse4.2";
+        case isa::avx2: return "avx2";
+        case isa::avx512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+inline std::optional<isa> parse_isa(const std::string_view name)
+{
+    for (const isa level : {isa::scalar, isa::sse42, isa::avx2, isa::avx512})
+        if (name == isa_name(level)) return level;
+    return std::nullopt;
+}
+
+#endif // RAY_TRACER_CPU_FEATURES
@@ -0,0 +1,164 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - adaptive_sampler.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_ADAPTIVE_SAMPLER
+#define RAY_TRACER_ADAPTIVE_SAMPLER
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "components/math/ray.hpp"
+#include "components/rendering/camera.hpp"
+#include "components/rendering/color.hpp"
+#include "components/rendering/pixel_estimate.hpp"
+#include "components/rendering/render_settings.hpp"
+#include "components/rendering/texture.hpp"
+#include "components/scene/scene.hpp"
+#include "systems/math/random.hpp"
+#include "systems/threading/thread_pool.hpp"
+
+// Samples each pixel until its relative error drops below render_settings::adaptive_error, within
+// [adaptive_min_ssp, adaptive_max_ssp] samples and a total of ssp samples per pixel on average.
+// Every pixel first gets adaptive_min_ssp samples; then rounds of adaptive_min_ssp more go to the
+// pixels still above the target, so what converged pixels leave of the budget goes to noisy ones.
+// A round that would overrun the budget goes to the noisiest pixels only.
+struct adaptive_sampler
+{
+    adaptive_sampler(const int width, const int height)
+        : width(width), height(height), pixels(width * height), round_samples(width * height)
+    {
+    }
+
+    void render(scene& sc, const camera& cam, thread_pool* pool)
+    {
+        const render_settings& settings = render_settings::global_settings;
+        const int min_spp = std::max(settings.adaptive_min_ssp, 2);
+        const int max_spp = std::max(settings.adaptive_max_ssp, min_spp);
+        const size_t budget = static_cast<size_t>(std::max(settings.ssp, min_spp)) * pixels.size();
+
+        std::fill(round_samples.begin(), round_samples.end(), min_spp);
+        for (int round = 0;; round++)
+        {
+            trace_round(sc, cam, round, pool);
+            for (const int n : round_samples) samples += n;
+
+            // the next round goes to the pixels still above the target, or to as many of the noisiest
+            // as the budget left affords
+            std::vector<float> errors;
+            for (size_t i = 0; i < pixels.size(); i++)
+            {
+                const int n = std::min<int>(min_spp, max_spp - static_cast<int>(pixels[i].count));
+                round_samples[i] = pixels[i].relative_error() > settings.adaptive_error ? std::max(n, 0) : 0;
+                if (round_samples[i] > 0) errors.push_back(pixels[i].relative_error());
+            }
+            if (errors.empty() || samples >= budget) break;
+
+            const size_t affordable = (budget - samples) / min_spp;
+            if (affordable == 0) break;
+            if (affordable < errors.size())
+            {
+                std::nth_element(errors.begin(), errors.begin() + (errors.size() - affordable), errors.end());
+                const float cutoff = errors[errors.size() - affordable];
+                for (size_t i = 0; i < pixels.size(); i++)
+                    if (round_samples[i] > 0 && pixels[i].relative_error() < cutoff) round_samples[i] = 0;
+            }
+        }
+    }
+
+    [[nodiscard]] color mean(const int x, const int y) const
+    {
+        return pixels[y * width + x].mean();
+    }
+
+    [[nodiscard]] size_t samples_taken() const
+    {
+        return samples;
+    }
+
+    [[nodiscard]] size_t converged_pixels() const
+    {
+        size_t n = 0;
+        for (const pixel_estimate& p : pixels) n += p.relative_error() <= render_settings::global_settings.adaptive_error;
+        return n;
+    }
+
+    // samples per pixel on a log scale, from blue (adaptive_min_ssp) over green to red (the most any
+    // pixel took), for tuning
+    [[nodiscard]] texture heatmap() const
+    {
+        uint32_t most = 0;
+        for (const pixel_estimate& p : pixels) most = std::max(most, p.count);
+        const float lo = std::log(static_cast<float>(std::max(render_settings::global_settings.adaptive_min_ssp, 2)));
+        const float hi = std::max(std::log(static_cast<float>(most)), lo + 1e-3f);
+        texture out(width, height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const float n = std::log(static_cast<float>(std::max(pixels[y * width + x].count, 1u)));
+                const float t = std::clamp((n - lo) / (hi - lo), 0.0f, 1.0f);
+                out.at(x, y) = color(std::clamp(2.0f * t - 1.0f, 0.0f, 1.0f), 1.0f - std::fabs(2.0f * t - 1.0f),
+                                     std::clamp(1.0f - 2.0f * t, 0.0f, 1.0f));
+            }
+        }
+        return out;
+    }
+
+private:
+    int width, height;
+    std::vector<pixel_estimate> pixels;
+    std::vector<int> round_samples; // what each pixel gets in the coming round
+    size_t samples{0};
+
+    // round_samples[i] samples of each pixel i, neighbouring pixels sharing packets as render_rows does
+    void trace_round(scene& sc, const camera& cam, const int round, thread_pool* pool)
+    {
+        const int packet_size = render_settings::global_settings.packet_size;
+        const int span = packet_size == 8 || packet_size == 16 ? packet_size : 1;
+
+        parallel_for(pool, 0, height, 1, [&](const size_t begin, const size_t end)
+        {
+            for (size_t y = begin; y < end; y++)
+            {
+                random::set_seed(static_cast<uint64_t>(round) * height + y);
+                for (int x0 = 0; x0 < width; x0 += span)
+                {
+                    const int count = std::min(span, width - x0);
+                    int most = 0;
+                    for (int i = 0; i < count; i++) most = std::max(most, round_samples[y * width + x0 + i]);
+
+                    for (int s = 0; s < most; s++)
+                    {
+                        ray rays[16];
+                        color out[16];
+                        int pixel_of[16];
+                        int active = 0;
+                        for (int i = 0; i < count; i++)
+                        {
+                            if (round_samples[y * width + x0 + i] <= s) continue;
+                            const float u = (x0 + i + .5f) / static_cast<float>(width);
+                            const float v = (y + .5f) / static_cast<float>(height);
+                            pixel_of[active] = x0 + i;
+                            rays[active++] = cam.generate_ray(u, v);
+                        }
+
+                        if (span == 16) sc.trace_packet<16>(rays, active, out);
+                        else if (span == 8) sc.trace_packet<8>(rays, active, out);
+                        else out[0] = sc.trace_ray(rays[0], 0);
+
+                        for (int i = 0; i < active; i++) pixels[y * width + pixel_of[i]].add(out[i]);
+                    }
+                }
+            }
+        });
+    }
+};
+
+#endif // RAY_TRACER_ADAPTIVE_SAMPLER
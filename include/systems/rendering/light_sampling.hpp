@@ -0,0 +1,189 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - light_sampling.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_LIGHT_SAMPLING
+#define RAY_TRACER_LIGHT_SAMPLING
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <variant>
+
+#include "components/acceleration/light_bvh.hpp"
+#include "components/geometry/sphere.hpp"
+#include "components/geometry/triangle.hpp"
+#include "components/math/vector3.hpp"
+#include "components/rendering/color.hpp"
+#include "components/rendering/light_list.hpp"
+#include "systems/math/random.hpp"
+
+// a point on an emitter, with the density it was picked with per unit area
+struct light_sample
+{
+    vector3 position;
+    vector3 normal;
+    color emission;
+    float pdf_area;
+};
+
+// uniform over the triangle's area
+inline vector3 sample_surface(const triangle& t, const float u1, const float u2, vector3& normal)
+{
+    const float su = std::sqrt(u1);
+    normal = t.normal();
+    return t.v0 * (1.0f - su) + t.v1 * (su * (1.0f - u2)) + t.v2 * (su * u2);
+}
+
+// uniform over the whole sphere, the half facing away is left to the shadow ray
+inline vector3 sample_surface(const sphere& s, const float u1, const float u2, vector3& normal)
+{
+    const float z = 1.0f - 2.0f * u1;
+    const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    const float phi = 2.0f * static_cast<float>(M_PI) * u2;
+    normal = vector3(r * std::cos(phi), r * std::sin(phi), z);
+    return s.center + normal * s.radius;
+}
+
+// A uniform point on e, which was picked with probability pmf; the density per unit area
+// is therefore pmf / area on e. Picked by area that is the same 1 / total area everywhere.
+inline light_sample sample_emitter(const emitter& e, const float pmf)
+{
+    const float u1 = randf();
+    const float u2 = randf();
+
+    light_sample ls;
+    ls.position = std::visit([&](const auto& s) { return sample_surface(s, u1, u2, ls.normal); }, e.shape);
+    ls.emission = e.emission;
+    ls.pdf_area = pmf / e.area;
+    return ls;
+}
+
+// ---------------------- Light BVH ----------------------
+// Picking walks from the root, taking each child with probability proportional to its
+// importance for the shading point, so the cost is the depth of the tree.
+
+// cos(max(0, a - b)) from the sines and cosines of a and b
+inline float cos_sub_clamped(const float sin_a, const float cos_a, const float sin_b, const float cos_b)
+{
+    return cos_a > cos_b ? 1.0f : cos_a * cos_b + sin_a * sin_b;
+}
+
+// sin(max(0, a - b))
+inline float sin_sub_clamped(const float sin_a, const float cos_a, const float sin_b, const float cos_b)
+{
+    return cos_a > cos_b ? 0.0f : sin_a * cos_b - cos_a * sin_b;
+}
+
+inline float sin_from_cos(const float c)
+{
+    return std::sqrt(std::max(0.0f, 1.0f - c * c));
+}
+
+// A bound on the light a group of emitters sends to p on a surface with normal n: their power over
+// the squared distance, times the cosine of the smallest angle any of them could face p at and the
+// cosine of the smallest angle p's surface could see any of them at. 0 only where none can reach p.
+inline float light_importance(const light_bounds& lb, const vector3& p, const vector3& n)
+{
+    if (lb.power <= 0.0f) return 0.0f;
+
+    const vector3 center = lb.bounds.centroid();
+    const float radius_2 = lb.bounds.extent().length_2() * 0.25f;
+    const float dist_2 = vector3::distance_2(p, center);
+    // clamped so points inside or right next to the group do not blow up
+    const float falloff_2 = std::max(dist_2, radius_2);
+
+    // the cone the bounds fill as seen from p, all of the sphere from inside the bounding sphere
+    const float sin_b_2 = dist_2 > radius_2 ? radius_2 / dist_2 : 1.0f;
+    const float cos_b = dist_2 > radius_2 ? std::sqrt(1.0f - sin_b_2) : -1.0f;
+    const float sin_b = dist_2 > radius_2 ? std::sqrt(sin_b_2) : 0.0f;
+
+    const vector3 to_p = dist_2 > 0.0f ? (p - center) / std::sqrt(dist_2) : lb.cone.axis;
+
+    // angle between the normals and p, narrowed by the cone of normals and by the bounds' extent;
+    // the emitters light both sides, so the axis only counts up to its sign
+    float cos_facing = 1.0f;
+    if (lb.cone.cos_theta_o > -1.0f)
+    {
+        const float cos_w = std::fabs(vector3::dot(lb.cone.axis, to_p));
+        const float sin_w = sin_from_cos(cos_w);
+        const float sin_o = sin_from_cos(lb.cone.cos_theta_o);
+        const float cos_x = cos_sub_clamped(sin_w, cos_w, sin_o, lb.cone.cos_theta_o);
+        const float sin_x = sin_sub_clamped(sin_w, cos_w, sin_o, lb.cone.cos_theta_o);
+        cos_facing = cos_sub_clamped(sin_x, cos_x, sin_b, cos_b);
+        if (cos_facing <= 0.0f) return 0.0f; // diffuse emitters send nothing past 90 degrees
+    }
+
+    // the same for the receiving surface, its sign left open as the path may be on either side
+    const float cos_i = std::fabs(vector3::dot(n, to_p));
+    const float cos_receive = cos_sub_clamped(sin_from_cos(cos_i), cos_i, sin_b, cos_b);
+
+    return lb.power * cos_facing * std::max(cos_receive, 0.0f) / falloff_2;
+}
+
+// Picks an emitter for p, with normal n, through the tree; u is a uniform number in [0, 1) and
+// is reused at every level. False where no emitter can reach p.
+inline bool pick_light(const light_bvh& tree, const vector3& p, const vector3& n, float u, uint32_t& emitter,
+                       float& pmf)
+{
+    if (tree.empty()) return false;
+
+    pmf = 1.0f;
+    uint32_t node = 0;
+    while (!tree.nodes[node].leaf)
+    {
+        const uint32_t second = tree.nodes[node].offset;
+        const float first_importance = light_importance(tree.nodes[node + 1].b, p, n);
+        const float second_importance = light_importance(tree.nodes[second].b, p, n);
+        const float sum = first_importance + second_importance;
+        if (sum <= 0.0f) return false;
+
+        const float p_first = first_importance / sum;
+        if (u < p_first)
+        {
+            node = node + 1;
+            pmf *= p_first;
+            u = std::min(u / p_first, 0x1.fffffep-1f);
+        }
+        else
+        {
+            node = second;
+            pmf *= second_importance / sum; // as light_pmf works it out
+            u = std::min((u - p_first) / (1.0f - p_first), 0x1.fffffep-1f);
+        }
+    }
+
+    emitter = tree.nodes[node].offset;
+    // a tree of one emitter never weighed it
+    return node != 0 || light_importance(tree.nodes[0].b, p, n) > 0.0f;
+}
+
+// probability of pick_light choosing emitter for p, following its trail down the tree
+inline float light_pmf(const light_bvh& tree, const vector3& p, const vector3& n, const uint32_t emitter)
+{
+    if (tree.empty()) return 0.0f;
+    if (tree.nodes[0].leaf) return light_importance(tree.nodes[0].b, p, n) > 0.0f ? 1.0f : 0.0f;
+
+    const uint64_t trail = tree.trails[emitter];
+    float pmf = 1.0f;
+    uint32_t node = 0;
+    for (int depth = 0; !tree.nodes[node].leaf; depth++)
+    {
+        const uint32_t second = tree.nodes[node].offset;
+        const float first_importance = light_importance(tree.nodes[node + 1].b, p, n);
+        const float second_importance = light_importance(tree.nodes[second].b, p, n);
+        const float sum = first_importance + second_importance;
+        if (sum <= 0.0f) return 0.0f;
+
+        const bool take_second = (trail >> depth) & 1u;
+        pmf *= (take_second ? second_importance : first_importance) / sum;
+        node = take_second ? second : node + 1;
+    }
+    return pmf;
+}
+
+#endif // RAY_TRACER_LIGHT_SAMPLING
@@ -0,0 +1,34 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - mis.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_MIS
+#define RAY_TRACER_MIS
+
+#include <cmath>
+
+// Densities per unit solid angle of the two ways a path finds an emitter from a diffuse hit, and
+// the weight that combines them. A mirror reflects into one direction only: light sampling never
+// picks it, so its bounces are weighted 1, and it never picks a light sample's direction.
+
+// density of the light sample at a point dist_2 squared away, seen at cos_light on the emitter,
+// from a sampler with density pdf_area per unit emitter area
+inline float light_pdf(const float pdf_area, const float dist_2, const float cos_light)
+{
+    return cos_light > 0.0f ? pdf_area * dist_2 / cos_light : 0.0f;
+}
+
+// power heuristic (beta = 2) weight of a sample taken with density pdf_taken, when the other
+// strategy would produce the same direction with density pdf_other
+inline float power_heuristic(const float pdf_taken, const float pdf_other)
+{
+    const float taken_2 = pdf_taken * pdf_taken;
+    const float other_2 = pdf_other * pdf_other;
+    return taken_2 > 0.0f ? taken_2 / (taken_2 + other_2) : 0.0f;
+}
+
+#endif // RAY_TRACER_MIS
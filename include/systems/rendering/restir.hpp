@@ -0,0 +1,258 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - restir.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_RESTIR
+#define RAY_TRACER_RESTIR
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "components/math/intersection.hpp"
+#include "components/math/ray.hpp"
+#include "components/math/vector3.hpp"
+#include "components/rendering/camera.hpp"
+#include "components/rendering/color.hpp"
+#include "components/rendering/render_settings.hpp"
+#include "components/rendering/reservoir.hpp"
+#include "components/scene/scene.hpp"
+#include "systems/math/random.hpp"
+#include "systems/rendering/light_sampling.hpp"
+#include "systems/threading/thread_pool.hpp"
+
+// one pixel's first hit, what resampling needs of it
+struct restir_surface
+{
+    vector3 position;
+    vector3 normal;       // turned towards the camera
+    color albedo;
+    float distance{0.0f}; // from the camera, to tell neighbours on other surfaces apart
+    bool valid{false};    // a diffuse hit with emitters to sample; the rest are path traced as usual
+};
+
+// Direct light at the first diffuse hits by reservoir resampling (ReSTIR DI), a pass over the whole
+// image at a time. Each pass
+//  1. traces one camera ray per pixel and path traces everything but that hit's direct light,
+//  2. resamples restir_candidates light samples into a reservoir per pixel by their unshadowed
+//     contribution, tests the one kept for visibility and merges in the reservoir the previous
+//     pass left at the same surface, found by reprojecting into the previous camera,
+//  3. merges in the reservoirs of restir_spatial_neighbours random pixels close by and shades the
+//     sample kept with one shadow ray. Those reservoirs are what the next pass reuses.
+// Reused samples are only shadow tested where they are shaded, so reuse across shadow edges leaves
+// some bias; reset() drops the history, for when emitters move.
+struct restir_renderer
+{
+    restir_renderer(const int width, const int height)
+        : width(width), height(height),
+          surfaces(width * height), previous_surfaces(width * height),
+          reservoirs(width * height), resampled(width * height)
+    {
+    }
+
+    void reset()
+    {
+        previous_camera.reset();
+    }
+
+    // adds one sample of every pixel to sums, width * height colours in scanline order
+    void render_pass(scene& sc, const camera& cam, color* sums, thread_pool* pool)
+    {
+        const bool resample = !sc.light_emitters().empty() &&
+                              render_settings::global_settings.debug == debug::off;
+
+        parallel_for(pool, 0, height, 1, [&](const size_t begin, const size_t end)
+        {
+            for (size_t y = begin; y < end; y++)
+            {
+                random::set_seed((static_cast<uint64_t>(pass) * 2) * height + y);
+                for (int x = 0; x < width; x++)
+                    sums[y * width + x] += first_hit(sc, cam, x, static_cast<int>(y), resample);
+            }
+        });
+
+        if (resample)
+        {
+            parallel_for(pool, 0, height, 1, [&](const size_t begin, const size_t end)
+            {
+                for (size_t y = begin; y < end; y++)
+                {
+                    random::set_seed((static_cast<uint64_t>(pass) * 2 + 1) * height + y);
+                    for (int x = 0; x < width; x++)
+                        sums[y * width + x] += reuse_spatially(sc, x, static_cast<int>(y));
+                }
+            });
+        }
+
+        std::swap(surfaces, previous_surfaces);
+        if (resample) previous_camera = cam;
+        else previous_camera.reset();
+        pass++;
+    }
+
+private:
+    static constexpr int MAX_NEIGHBOURS = 16;
+
+    int width, height;
+    std::vector<restir_surface> surfaces, previous_surfaces;
+    std::vector<reservoir> reservoirs; // after the temporal merge
+    std::vector<reservoir> resampled;  // after the spatial merge, the next pass's history
+    std::optional<camera> previous_camera; // of the pass that left resampled, none without history
+    uint32_t pass{0};
+
+    // The unshadowed light y sends to s, up to the constant 1 / pi: the target the samples are
+    // resampled towards. Emitters light both sides.
+    static float target(const restir_surface& s, const light_sample& y)
+    {
+        const vector3 to_light = y.position - s.position;
+        const float dist_2 = to_light.length_2();
+        if (!(dist_2 > 0.0f)) return 0.0f;
+        const vector3 dir = to_light / std::sqrt(dist_2);
+        const float cos_surface = vector3::dot(s.normal, dir);
+        if (cos_surface <= 0.0f) return 0.0f;
+        const float cos_light = std::fabs(vector3::dot(y.normal, dir));
+        return (s.albedo * y.emission).luminance() * cos_surface * cos_light / dist_2;
+    }
+
+    // close enough in orientation, and to the expected distance from its camera, to share samples
+    static bool similar(const restir_surface& s, const restir_surface& other, const float expected_distance)
+    {
+        return other.valid && vector3::dot(s.normal, other.normal) > 0.9f &&
+               std::fabs(other.distance - expected_distance) < 0.1f * expected_distance;
+    }
+
+    // one reservoir to merge, the surface it was resampled for and the candidates it counts for
+    struct reuse_input
+    {
+        const reservoir* r;
+        const restir_surface* s;
+        float m;
+    };
+
+    // Resamples inputs, the first being s's own, into one reservoir for s. Each input's sample is
+    // weighted by the balance heuristic over the surfaces of all inputs, by how likely each was to
+    // keep it: a sample from a surface that barely sees its light cannot turn into a firefly at s,
+    // which sees it well, and surfaces that cannot see it at all do not darken s.
+    static reservoir merge(const restir_surface& s, const reuse_input* inputs, const int count)
+    {
+        reservoir out;
+        for (int i = 0; i < count; i++)
+        {
+            const reservoir& r = *inputs[i].r;
+            float weight = 0.0f;
+            if (r.w > 0.0f)
+            {
+                float all = 0.0f;
+                for (int j = 0; j < count; j++) all += inputs[j].m * target(*inputs[j].s, r.y);
+                weight = inputs[i].m * target(*inputs[i].s, r.y) / all * target(s, r.y) * r.w;
+            }
+            out.update(r.y, weight, inputs[i].m, randf());
+        }
+
+        const float target_y = out.w_sum > 0.0f ? target(s, out.y) : 0.0f;
+        if (target_y > 0.0f) out.w = out.w_sum / target_y;
+        return out;
+    }
+
+    // steps 1 and 2 for pixel (x, y); returns its path traced light without the direct light there
+    color first_hit(scene& sc, const camera& cam, const int x, const int y, const bool resample)
+    {
+        const int i = y * width + x;
+        const ray r = cam.generate_ray((x + .5f) / static_cast<float>(width), (y + .5f) / static_cast<float>(height));
+        intersection is;
+        const material* hit_mat = sc.closest_hit(r, is);
+
+        restir_surface& s = surfaces[i];
+        s.valid = resample && hit_mat && hit_mat->reflectivity <= 0.0f;
+        const color path = sc.shade(r, is, hit_mat, 0, s.valid);
+        reservoirs[i] = {};
+        if (!s.valid) return path;
+
+        s.normal = vector3::dot(is.normal, r.direction) > 0.0f ? -is.normal : is.normal;
+        s.position = r.at(is.intersection_distance) + s.normal * 1e-4f;
+        s.albedo = hit_mat->albedo;
+        s.distance = is.intersection_distance;
+
+        // resampled importance sampling of the candidates, in area measure
+        reservoir& own = reservoirs[i];
+        const int candidates = std::max(1, render_settings::global_settings.restir_candidates);
+        for (int c = 0; c < candidates; c++)
+        {
+            light_sample ls;
+            const bool picked = sc.sample_light(s.position, s.normal, ls);
+            own.update(ls, picked ? target(s, ls) / ls.pdf_area : 0.0f, 1.0f, randf());
+        }
+        const float target_y = own.w_sum > 0.0f ? target(s, own.y) : 0.0f;
+        if (target_y > 0.0f && sc.light_visible(s.position, own.y.position))
+            own.w = own.w_sum / (own.m * target_y);
+
+        // the previous pass's reservoir at the same surface, its history capped so it keeps adapting
+        const int history_limit = render_settings::global_settings.restir_history_limit;
+        float u, v;
+        if (!previous_camera || history_limit <= 0 || !previous_camera->project(s.position, u, v)) return path;
+        const int px = static_cast<int>(std::floor(u * width));
+        const int py = static_cast<int>(std::floor(v * height));
+        if (px < 0 || px >= width || py < 0 || py >= height) return path;
+
+        const int j = py * width + px;
+        const restir_surface& previous = previous_surfaces[j];
+        if (!similar(s, previous, vector3::distance(previous_camera->pos, s.position))) return path;
+
+        const reservoir current = own;
+        const reuse_input inputs[2] = {
+            {&current, &s, current.m},
+            {&resampled[j], &previous, std::min(resampled[j].m, static_cast<float>(history_limit * candidates))}
+        };
+        own = merge(s, inputs, 2);
+        return path;
+    }
+
+    // step 3 for pixel (x, y); returns the direct light at its first hit
+    color reuse_spatially(scene& sc, const int x, const int y)
+    {
+        const int i = y * width + x;
+        const restir_surface& s = surfaces[i];
+        if (!s.valid)
+        {
+            resampled[i] = {};
+            return {};
+        }
+
+        reuse_input inputs[MAX_NEIGHBOURS + 1];
+        inputs[0] = {&reservoirs[i], &s, reservoirs[i].m};
+        int count = 1;
+        const int neighbours = std::clamp(render_settings::global_settings.restir_spatial_neighbours, 0, MAX_NEIGHBOURS);
+        const float radius = render_settings::global_settings.restir_spatial_radius;
+        for (int k = 0; k < neighbours; k++)
+        {
+            const float r = radius * std::sqrt(randf());
+            const float phi = 2.0f * static_cast<float>(M_PI) * randf();
+            const int nx = x + static_cast<int>(std::lround(r * std::cos(phi)));
+            const int ny = y + static_cast<int>(std::lround(r * std::sin(phi)));
+            if (nx < 0 || nx >= width || ny < 0 || ny >= height || (nx == x && ny == y)) continue;
+
+            const int j = ny * width + nx;
+            if (!similar(s, surfaces[j], s.distance)) continue;
+            inputs[count++] = {&reservoirs[j], &surfaces[j], reservoirs[j].m};
+        }
+
+        const reservoir& out = resampled[i] = merge(s, inputs, count);
+        if (out.w <= 0.0f || !sc.light_visible(s.position, out.y.position)) return {};
+
+        const vector3 to_light = out.y.position - s.position;
+        const float dist_2 = to_light.length_2();
+        const vector3 dir = to_light / std::sqrt(dist_2);
+        const float cos_surface = vector3::dot(s.normal, dir);
+        const float cos_light = std::fabs(vector3::dot(out.y.normal, dir));
+        return s.albedo * out.y.emission * (cos_surface * cos_light * out.w / (static_cast<float>(M_PI) * dist_2));
+    }
+};
+
+#endif // RAY_TRACER_RESTIR
@@ -0,0 +1,284 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - wavefront.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_WAVEFRONT
+#define RAY_TRACER_WAVEFRONT
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "components/math/hit_record.hpp"
+#include "components/math/intersection.hpp"
+#include "components/math/ray.hpp"
+#include "components/rendering/camera.hpp"
+#include "components/rendering/color.hpp"
+#include "components/rendering/path_state.hpp"
+#include "components/scene/scene.hpp"
+#include "systems/math/random.hpp"
+#include "systems/threading/thread_pool.hpp"
+
+// Rays of many paths in SoA form, each tagged with the path it continues.
+struct ray_queue
+{
+    std::vector<float> ox, oy, oz;
+    std::vector<float> dx, dy, dz;
+    std::vector<uint32_t> path;
+    size_t size{0};
+
+    explicit ray_queue(const size_t capacity)
+        : ox(capacity), oy(capacity), oz(capacity), dx(capacity), dy(capacity), dz(capacity), path(capacity)
+    {
+    }
+
+    void set(const size_t i, const ray& r, const uint32_t path_index)
+    {
+        ox[i] = r.origin.x; oy[i] = r.origin.y; oz[i] = r.origin.z;
+        dx[i] = r.direction.x; dy[i] = r.direction.y; dz[i] = r.direction.z;
+        path[i] = path_index;
+    }
+
+    // copies entry i of other to entry j
+    void copy(const size_t j, const ray_queue& other, const size_t i)
+    {
+        ox[j] = other.ox[i]; oy[j] = other.oy[i]; oz[j] = other.oz[i];
+        dx[j] = other.dx[i]; dy[j] = other.dy[i]; dz[j] = other.dz[i];
+        path[j] = other.path[i];
+    }
+
+    // the direction is stored normalised already, so it is not normalised again
+    [[nodiscard]] ray at(const size_t i) const
+    {
+        ray r;
+        r.origin = vector3(ox[i], oy[i], oz[i]);
+        r.direction = vector3(dx[i], dy[i], dz[i]);
+        return r;
+    }
+};
+
+// Shadow rays in SoA form, with how far each may go and the light it brings its path if unblocked.
+struct shadow_queue
+{
+    ray_queue rays;
+    std::vector<float> t_max;
+    std::vector<color> contribution;
+
+    explicit shadow_queue(const size_t capacity) : rays(capacity), t_max(capacity), contribution(capacity) {}
+
+    void set(const size_t i, const shadow_query& q, const uint32_t path_index)
+    {
+        rays.set(i, q.r, path_index);
+        t_max[i] = q.t_max;
+        contribution[i] = q.contribution;
+    }
+};
+
+// what one stage of a wavefront render did, summed over its waves
+struct wavefront_stage_stats
+{
+    size_t items{0};
+    double ms{0.0};
+
+    [[nodiscard]] double mitems_per_second() const { return ms > 0.0 ? items / (ms * 1e3) : 0.0; }
+};
+
+struct wavefront_stats
+{
+    wavefront_stage_stats generate;  // camera rays
+    wavefront_stage_stats intersect; // closest hits, of camera and bounce rays
+    wavefront_stage_stats shade;     // hits sorted by material and scattered
+    wavefront_stage_stats shadow;    // shadow rays of the light samples
+};
+
+// Path tracing one stage at a time over waves of up to wave_paths paths, instead of one path
+// per call as render_rows does with scene::shade. Each wave generates its camera rays, then
+// until no path is left
+//  - intersect finds the closest hit of every queued ray,
+//  - shade sorts the hits by material and runs scene::scatter on each, which queues the
+//    bounced ray and the shadow ray of the light sample,
+//  - shadow traces the shadow rays and adds the light of the unblocked ones,
+// so every stage runs the same code over a large batch across the thread pool. The estimate
+// per path is scene::shade's; only the order the random numbers are drawn in differs.
+struct wavefront_renderer
+{
+    static constexpr size_t GRAIN = 1024; // queue entries per task
+
+    wavefront_renderer(const int width, const int height, const size_t wave_paths)
+        : width(width), height(height), capacity(std::max<size_t>(wave_paths, 1)),
+          rays(capacity), bounced(capacity), shadows(capacity), pending(capacity),
+          hits(capacity), order(capacity), alive(capacity), paths(capacity)
+    {
+    }
+
+    // The mean of spp samples of every pixel into pixels, width * height colours in scanline order.
+    // Sample s of pixel p is path p * spp + s of the image; waves take the next capacity of those,
+    // so a pixel's samples may be split across waves when spp is more than a wave holds.
+    void render(const scene& sc, const camera& cam, const int spp, color* pixels, thread_pool* pool)
+    {
+        if (spp <= 0) throw std::invalid_argument("wavefront_renderer: spp must be positive");
+
+        const size_t pixel_count = static_cast<size_t>(width) * height;
+        const size_t path_count = pixel_count * spp;
+        std::fill(pixels, pixels + pixel_count, color(0.0f));
+        for (size_t first = 0; first < path_count; first += capacity)
+        {
+            const size_t count = std::min(capacity, path_count - first);
+            generate(cam, first, count, spp, pool);
+            for (bool camera_rays = true; rays.size > 0; camera_rays = false)
+            {
+                intersect(sc, pool);
+                shade(sc, camera_rays, pool);
+                trace_shadows(sc, pool);
+            }
+
+            for (size_t i = 0; i < count; i++) pixels[(first + i) / spp] += paths[i].radiance;
+        }
+        for (size_t p = 0; p < pixel_count; p++) pixels[p] /= float(spp);
+    }
+
+    [[nodiscard]] const wavefront_stats& stats() const
+    {
+        return totals;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    int width, height;
+    size_t capacity;
+    ray_queue rays;         // waiting for intersect
+    ray_queue bounced;      // written by shade at the index of the ray they continue
+    shadow_queue shadows;   // waiting for trace_shadows
+    std::vector<shadow_query> pending; // written by shade at the index of the ray that asked
+    std::vector<hit_record> hits;
+    std::vector<uint32_t> order; // rays by material of their hit, the order shade visits them in
+    std::vector<uint8_t> alive;  // bounced[i] holds a ray
+    std::vector<path_state> paths;
+    wavefront_stats totals;
+    uint32_t launches{0}; // of the stages that draw random numbers, to seed each task apart
+
+    static double ms_since(const clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+
+    // seeds the calling thread for the task of queue entries from begin
+    void seed(const size_t begin) const
+    {
+        random::set_seed(static_cast<uint64_t>(launches) * 4096 + begin / GRAIN);
+    }
+
+    // camera rays for count paths of the image from first, at most capacity
+    void generate(const camera& cam, const size_t first, const size_t count, const int spp, thread_pool* pool)
+    {
+        const auto start = clock::now();
+        launches++;
+        rays.size = count;
+        parallel_for(pool, 0, rays.size, GRAIN, [&](const size_t begin, const size_t end)
+        {
+            seed(begin);
+            for (size_t i = begin; i < end; i++)
+            {
+                const size_t pixel = (first + i) / spp;
+                const float u = (static_cast<float>(pixel % width) + .5f) / static_cast<float>(width);
+                const float v = (static_cast<float>(pixel / width) + .5f) / static_cast<float>(height);
+                rays.set(i, cam.generate_ray(u, v), static_cast<uint32_t>(i));
+                paths[i] = {};
+            }
+        });
+        totals.generate.items += rays.size;
+        totals.generate.ms += ms_since(start);
+    }
+
+    void intersect(const scene& sc, thread_pool* pool)
+    {
+        const auto start = clock::now();
+        parallel_for(pool, 0, rays.size, GRAIN, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; i++) hits[i] = sc.find_closest_hit(rays.at(i));
+        });
+        totals.intersect.items += rays.size;
+        totals.intersect.ms += ms_since(start);
+    }
+
+    // scatters every hit, by material, then keeps the rays that bounced in queue order
+    void shade(const scene& sc, const bool camera_rays, thread_pool* pool)
+    {
+        const auto start = clock::now();
+        launches++;
+
+        // counting sort by material id, misses last
+        const size_t materials = sc.material_count();
+        std::vector<uint32_t> offsets(materials + 2, 0);
+        for (size_t i = 0; i < rays.size; i++)
+            offsets[(hits[i].found() ? sc.hit_material(hits[i]) : materials) + 1]++;
+        for (size_t m = 1; m < offsets.size(); m++) offsets[m] += offsets[m - 1];
+        for (size_t i = 0; i < rays.size; i++)
+            order[offsets[hits[i].found() ? sc.hit_material(hits[i]) : materials]++] = static_cast<uint32_t>(i);
+
+        parallel_for(pool, 0, rays.size, GRAIN, [&](const size_t begin, const size_t end)
+        {
+            seed(begin);
+            for (size_t k = begin; k < end; k++)
+            {
+                const uint32_t i = order[k];
+                alive[i] = 0;
+                pending[i].pending = false;
+
+                ray r = rays.at(i);
+                intersection is;
+                const material* hit_mat = sc.surface_interaction(r, hits[i], is);
+                if (!hit_mat) continue;
+
+                path_state& path = paths[rays.path[i]];
+                color debug_view;
+                if (camera_rays && sc.debug_color(is, *hit_mat, debug_view))
+                {
+                    path.radiance = debug_view;
+                    continue;
+                }
+
+                if (sc.scatter(r, is, hits[i], *hit_mat, path, pending[i]))
+                {
+                    bounced.set(i, r, rays.path[i]);
+                    alive[i] = 1;
+                }
+            }
+        });
+
+        const size_t shaded = rays.size;
+        size_t kept = 0;
+        shadows.rays.size = 0;
+        for (size_t i = 0; i < shaded; i++)
+        {
+            if (pending[i].pending) shadows.set(shadows.rays.size++, pending[i], rays.path[i]);
+            if (alive[i]) rays.copy(kept++, bounced, i);
+        }
+        rays.size = kept;
+
+        totals.shade.items += shaded;
+        totals.shade.ms += ms_since(start);
+    }
+
+    void trace_shadows(const scene& sc, thread_pool* pool)
+    {
+        const auto start = clock::now();
+        parallel_for(pool, 0, shadows.rays.size, GRAIN, [&](const size_t begin, const size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+                if (!sc.occluded(shadows.rays.at(i), shadows.t_max[i]))
+                    paths[shadows.rays.path[i]].radiance += shadows.contribution[i];
+        });
+        totals.shadow.items += shadows.rays.size;
+        totals.shadow.ms += ms_since(start);
+    }
+};
+
+#endif // RAY_TRACER_WAVEFRONT
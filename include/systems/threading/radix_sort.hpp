@@ -0,0 +1,80 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - radix_sort.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_RADIX_SORT
+#define RAY_TRACER_RADIX_SORT
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "systems/threading/thread_pool.hpp"
+
+// Stable LSD radix sort of (key, value) pairs, 8 bits per pass.
+// Every pass builds per-chunk histograms in parallel, prefix-sums them in
+// chunk order and scatters each chunk in parallel, so the result is the same
+// for any thread count. Only the low key_bits of each key are sorted on.
+template <typename Key>
+void parallel_radix_sort(thread_pool* pool, std::vector<Key>& keys, std::vector<uint32_t>& values, const int key_bits)
+{
+    constexpr int RADIX_BITS = 8;
+    constexpr size_t BUCKETS = 1u << RADIX_BITS;
+    constexpr size_t GRAIN = 65536;
+
+    const size_t n = keys.size();
+    if (n <= 1) return;
+
+    std::vector<Key> keys_tmp(n);
+    std::vector<uint32_t> values_tmp(n);
+
+    const size_t chunk_count = (n + GRAIN - 1) / GRAIN;
+    std::vector<std::array<size_t, BUCKETS>> offsets(chunk_count);
+
+    for (int shift = 0; shift < key_bits; shift += RADIX_BITS)
+    {
+        parallel_for(pool, 0, chunk_count, 1, [&](const size_t c0, const size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+            {
+                offsets[c].fill(0);
+                const size_t end = std::min(n, (c + 1) * GRAIN);
+                for (size_t i = c * GRAIN; i < end; i++) offsets[c][(keys[i] >> shift) & (BUCKETS - 1)]++;
+            }
+        });
+
+        // bucket-major, chunk-minor prefix sum keeps the sort stable
+        size_t running = 0;
+        for (size_t b = 0; b < BUCKETS; b++)
+            for (size_t c = 0; c < chunk_count; c++)
+            {
+                const size_t count = offsets[c][b];
+                offsets[c][b] = running;
+                running += count;
+            }
+
+        parallel_for(pool, 0, chunk_count, 1, [&](const size_t c0, const size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+            {
+                const size_t end = std::min(n, (c + 1) * GRAIN);
+                for (size_t i = c * GRAIN; i < end; i++)
+                {
+                    const size_t dst = offsets[c][(keys[i] >> shift) & (BUCKETS - 1)]++;
+                    keys_tmp[dst] = keys[i];
+                    values_tmp[dst] = values[i];
+                }
+            }
+        });
+
+        keys.swap(keys_tmp);
+        values.swap(values_tmp);
+    }
+}
+
+#endif // RAY_TRACER_RADIX_SORT
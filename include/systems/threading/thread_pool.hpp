@@ -0,0 +1,152 @@
+// -----------------------------------------------------------------------------
+//
+//  ray_tracer - thread_pool.hpp
+//
+// -----------------------------------------------------------------------------
+
+
+
+#ifndef RAY_TRACER_THREAD_POOL
+#define RAY_TRACER_THREAD_POOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling from one shared task queue.
+// Created once in main and handed to everything that wants to run in parallel
+// (BVH builds, rendering rows) so no stage spins up threads of its own.
+struct thread_pool
+{
+public:
+    explicit thread_pool(const unsigned thread_count = std::thread::hardware_concurrency())
+    {
+        const unsigned count = std::max(1u, thread_count);
+        workers.reserve(count);
+        for (unsigned i = 0; i < count; i++)
+            workers.emplace_back([this] { worker_loop(); });
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    [[nodiscard]] unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // runs one queued task on the calling thread, false if there was none
+    bool run_pending_task()
+    {
+        std::function<void()> task;
+        {
+            std::lock_guard lock(mutex);
+            if (tasks.empty()) return false;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+
+private:
+    void worker_loop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return; // stopping and drained
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping{false};
+};
+
+// Tasks that can be waited on together. Waiting threads execute queued tasks
+// instead of blocking, so tasks may spawn and wait on groups of their own.
+struct task_group
+{
+public:
+    explicit task_group(thread_pool& pool) : pool(pool) {}
+    ~task_group() { wait(); }
+
+    template <typename Fn>
+    void run(Fn&& fn)
+    {
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pool.submit([this, fn = std::forward<Fn>(fn)]() mutable
+        {
+            fn();
+            pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void wait()
+    {
+        while (pending.load(std::memory_order_acquire) > 0)
+        {
+            if (!pool.run_pending_task()) std::this_thread::yield();
+        }
+    }
+
+    [[nodiscard]] bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    thread_pool& pool;
+    std::atomic<int> pending{0};
+};
+
+// Calls fn(chunk_begin, chunk_end) over [begin,end) in chunks of about grain items.
+// Runs inline without a pool or when the range is a single chunk.
+template <typename Fn>
+void parallel_for(thread_pool* pool, const size_t begin, const size_t end, const size_t grain, const Fn& fn)
+{
+    if (begin >= end) return;
+    if (!pool || end - begin <= grain)
+    {
+        fn(begin, end);
+        return;
+    }
+
+    task_group group(*pool);
+    for (size_t chunk = begin; chunk < end; chunk += grain)
+    {
+        const size_t chunk_end = std::min(end, chunk + grain);
+        group.run([&fn, chunk, chunk_end] { fn(chunk, chunk_end); });
+    }
+    group.wait();
+}
+
+#endif // RAY_TRACER_THREAD_POOL
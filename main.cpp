@@ -13,34 +13,32 @@
 #include <atomic>
 #include <mutex>
 #include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <optional>
 #include <random>
+#include <string>
 #include <thread>
 #include <chrono>
 
 #include "components/rendering/camera.hpp"
 #include "components/scene/scene.hpp"
-
-int main()
+#include "systems/benchmark/intersection_check.hpp"
+#include "systems/benchmark/light_check.hpp"
+#include "systems/benchmark/math_benchmark.hpp"
+#include "systems/benchmark/traversal_benchmark.hpp"
+#include "systems/platform/cpu_features.hpp"
+#include "systems/rendering/adaptive_sampler.hpp"
+#include "systems/rendering/restir.hpp"
+#include "systems/rendering/wavefront.hpp"
+#include "systems/threading/thread_pool.hpp"
+
+void add_cornell_room(scene& scene, const float s, const float d)
 {
-    constexpr int width = 1920/4;
-    constexpr int height = 1080/4;
-
-    texture img(width, height);
-    scene scene{};
-
-
-    float s = 10;
-    float d = 10;
-
     // Room corners
     vector3 p0(-s,-s,-s), p1(s,-s,-s), p2(s,s,-s), p3(-s,s,-s);
     vector3 p4(-s,-s,d), p5(s,-s,d), p6(s,s,d), p7(-s,s,d);
 
-    // Reflectivity
-    float main_r = 0.0f;
-    float vertical_r = 0;
-
     color mainc = color(0.5,0.2,0.2);
 
     color cr = color(0.9,0.2,0.2);
@@ -50,44 +48,97 @@ int main()
 
     color mirrorc = color(0.85);
 
+    const material_id blue = scene.add_material(material(cb,0));
+    const material_id light = scene.add_material(material(mainc,0,(color){0.4}));
+    const material_id mirror = scene.add_material(material(mirrorc,1));
+    const material_id red = scene.add_material(material(cr,0));
+    const material_id green = scene.add_material(material(cg,0));
 
      // Floor (normal pointing up +Y)
-     scene.add_object((object){triangle(p0,p1,p5), material(cb,0)});
-     scene.add_object((object){triangle(p0,p5,p4), material(cb,0)});
+     scene.add_object((object){triangle(p0,p1,p5), blue});
+     scene.add_object((object){triangle(p0,p5,p4), blue});
 
      // Ceiling (normal pointing down -Y)
-     scene.add_object((object){triangle(p3,p6,p2), material(mainc,0,(color){0.4})});
-     scene.add_object((object){triangle(p3,p7,p6), material(mainc,0,(color){0.4})});
+     scene.add_object((object){triangle(p3,p6,p2), light});
+     scene.add_object((object){triangle(p3,p7,p6), light});
 
      // Left wall (normal pointing right +X)
-     scene.add_object((object){triangle(p4,p7,p3), material(mirrorc,1)});
-     scene.add_object((object){triangle(p4,p3,p0), material(mirrorc,1)});
+     scene.add_object((object){triangle(p4,p7,p3), mirror});
+     scene.add_object((object){triangle(p4,p3,p0), mirror});
 
      // Right wall (normal pointing left -X)
-     scene.add_object((object){triangle(p1,p2,p6), material(cr,0)});
-     scene.add_object((object){triangle(p1,p6,p5), material(cr,0)});
+     scene.add_object((object){triangle(p1,p2,p6), red});
+     scene.add_object((object){triangle(p1,p6,p5), red});
 
      // Back wall (normal pointing forward +Z)
-     scene.add_object((object){triangle(p0,p3,p2), material(mirrorc,1)});
-     scene.add_object((object){triangle(p0,p2,p1), material(mirrorc,1)});
+     scene.add_object((object){triangle(p0,p3,p2), mirror});
+     scene.add_object((object){triangle(p0,p2,p1), mirror});
 
      // Front wall (normal pointing backward -Z)
-     scene.add_object((object){triangle(p4,p5,p6), material(cg, 0)});
-     scene.add_object((object){triangle(p4,p6,p7), material(cg,0)});
-
+     scene.add_object((object){triangle(p4,p5,p6), green});
+     scene.add_object((object){triangle(p4,p6,p7), green});
+}
 
+// instanced places one shared unit sphere per cell instead of copying it into the scene
+void add_sphere_grid(scene& scene, const int grid, const float grid_size, const bool instanced = false)
+{
     auto pillar_color = color(1);
-    auto test = color(1.0);
-    auto test_light = color(5);
-    float pillar_ref = 1;
+    const material_id pillar_material = scene.add_material(material(pillar_color,1));
+    const size_t pillar = instanced ? scene.add_prototype({(object){sphere(vector3(0,0,0),1),pillar_material}}) : 0;
 
-    int grid = 1;
-    float grid_size = 6;
     for (int zoff = -grid; zoff <= grid; zoff += 1)
     {
         for (int xoff = -grid; xoff <= grid; xoff += 1)
-            scene.add_object((object){sphere(vector3(xoff*grid_size, 0,zoff*grid_size),1),material(pillar_color,1)});
+        {
+            const vector3 center(xoff*grid_size, 0,zoff*grid_size);
+            if (instanced)
+                scene.add_instance(pillar, transform::translation(center));
+            else
+                scene.add_object((object){sphere(center,1),pillar_material});
+        }
     }
+}
+
+int main(int argc, char** argv)
+{
+    constexpr int width = 1920/4;
+    constexpr int height = 1080/4;
+
+    bool benchmark = false;
+    bool forced_isa = false;
+    unsigned n_threads = render_settings::global_settings.multithreaded ? std::thread::hardware_concurrency() : 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--bench") benchmark = true;
+        if (std::string(argv[i]) == "--threads" && i + 1 < argc) n_threads = std::stoi(argv[++i]);
+        if (std::string(argv[i]) == "--isa" && i + 1 < argc)
+        {
+            // forces a lower kernel level, to compare them on one machine
+            const std::optional<isa> level = parse_isa(argv[++i]);
+            if (!level) std::cerr << "unknown --isa " << argv[i] << ", expected scalar, sse4.2, avx2 or avx512\n";
+            else if (!isa_supported(*level)) std::cerr << "--isa " << argv[i] << " is not supported by this CPU\n";
+            else
+            {
+                render_settings::global_settings.kernel_isa = *level;
+                forced_isa = true;
+            }
+        }
+    }
+    std::cout << "kernels: " << isa_name(render_settings::global_settings.kernel_isa) << " (CPU supports "
+              << isa_name(detect_isa()) << (forced_isa ? ", forced by --isa" : "") << ")\n";
+
+    // one pool for the whole run, the BVH build and the render rows share it
+    thread_pool pool(n_threads);
+
+    texture img(width, height);
+    scene scene{};
+
+
+    float s = 10;
+    float d = 10;
+
+    add_cornell_room(scene, s, d);
+    add_sphere_grid(scene, 1, 6, true);
 
     float l = d*(width/height)*0.9; // 0.95
     vector3 cam_pos(l,8,l);
@@ -96,44 +147,112 @@ int main()
     float aspect = float(width)/height;
     float fov = 0.5f;
 
+    if (benchmark)
+    {
+        intersection_check::triangle_records(1000000, std::cout);
+        intersection_check::triangle_kernels(1000000, std::cout);
+        intersection_check::sphere_kernels(1000000, std::cout);
+        light_check::instanced_sphere_light("uniformly scaled sphere lamp",
+                                            transform::translation(vector3(0, 2.5f, 0)) * transform::scale(2.0f), 64, 64, std::cout);
+        light_check::instanced_sphere_light("flattened sphere lamp",
+                                            transform::translation(vector3(0, 1, 0)) * transform::scale(vector3(3, 0.2f, 3)), 64, 64, std::cout);
+        math_benchmark::run(4000000, std::cout);
+
+        camera bench_cam = camera(cam_pos, cam_look, cam_up,fov,aspect);
+        traversal_benchmark::run(scene, bench_cam, "cornell room", width, height, std::cout);
+
+        ::scene grid_scene{};
+        add_sphere_grid(grid_scene, 50, 2.5f);
+        traversal_benchmark::run(grid_scene, bench_cam, "sphere grid", width, height, std::cout);
+
+        // the same tessellated sphere as one indexed mesh and as separate triangles
+        const mesh ball = mesh::uv_sphere(vector3(0,0,0), 6, 200, 400);
+        ::scene mesh_scene{};
+        mesh_scene.add_mesh(ball, mesh_scene.add_material(material(color(1),0)));
+        traversal_benchmark::run(mesh_scene, bench_cam, "mesh sphere", width, height, std::cout);
+
+        ::scene triangle_scene{};
+        const material_id white = triangle_scene.add_material(material(color(1),0));
+        for (size_t i = 0; i < ball.triangle_count(); i++)
+            triangle_scene.add_object((object){ball.triangle_at(i), white});
+        traversal_benchmark::run(triangle_scene, bench_cam, "triangle sphere", width, height, std::cout);
+        return 0;
+    }
+
+    const bvh_build_stats& bvh_stats = scene.build_acceleration(&pool);
+    std::cout << "BVH: " << scene.object_count() << " objects, " << scene.instance_count() << " instances of "
+              << scene.prototype_count() << " prototypes, " << pool.size() << " threads, "
+              << bvh_stats.node_count << " nodes (" << bvh_stats.leaf_count << " leaves, depth " << bvh_stats.max_depth << "), "
+              << "SAH cost " << bvh_stats.sah_cost << ", built in " << bvh_stats.build_ms << "ms\n";
+    std::cout << "lights: " << scene.light_emitters().size() << " emitters, " << scene.light_emitters().total_area
+              << " area";
+    if (render_settings::global_settings.next_event_estimation)
+        std::cout << ", sampled directly "
+                  << (render_settings::global_settings.light_picking == light_selection::by_importance ? "through a light BVH" : "by area");
+    if (render_settings::global_settings.reservoir_resampling)
+        std::cout << ", resampled in reservoirs at first hits";
+    std::cout << "\n";
+
     camera cam = camera(cam_pos, cam_look, cam_up,fov,aspect);
     cam.focus_dist = cam_pos.length();
     cam.lens_radius = 1;
 
 
     // Multithreading
-    const int n_threads = static_cast<int>(1);
-    std::vector<std::thread> threads;
     std::atomic<int> rows_done(0);
     std::mutex print_mutex;
 
+    // primary rays of neighbouring pixels are coherent, so up to packet_size pixels share one packet per sample
+    const int packet_size = render_settings::global_settings.packet_size;
+    const int span = packet_size == 8 || packet_size == 16 ? packet_size : 1;
+
+    auto to_display = [](const color& pixel)
+    {
+        color mapped(
+            (pixel.r),
+            (pixel.g),
+            (pixel.b)
+        );
+        color display(
+            std::pow(mapped.r, 1.0f/2.2f),
+            std::pow(mapped.g, 1.0f/2.2f),
+            std::pow(mapped.b, 1.0f/2.2f)
+        );
+        return display.clamped();
+    };
+
     auto render_rows = [&](const int start, const int end)
     {
         random::set_seed(start);
 
         for(int y=start; y<end; y++)
         {
-            for(int x=0; x<width; x++)
+            for(int x0=0; x0<width; x0+=span)
             {
-                color pixel(0,0,0);
+                const int count = std::min(span, width - x0);
+                color pixels[16];
+                for(int i=0; i<count; i++) pixels[i] = color(0,0,0);
+
                 for(int s_i=0; s_i<render_settings::global_settings.ssp; s_i++)
                 {
-                    float u = (x + .5f) / static_cast<float>(width);
-                    float v = (y + .5f) / static_cast<float>(height);
-                    pixel += scene.trace_ray(cam.generate_ray(u,v), 0 );
+                    ray rays[16];
+                    color samples[16];
+                    for(int i=0; i<count; i++)
+                    {
+                        float u = (x0 + i + .5f) / static_cast<float>(width);
+                        float v = (y + .5f) / static_cast<float>(height);
+                        rays[i] = cam.generate_ray(u,v);
+                    }
+
+                    if (span == 16) scene.trace_packet<16>(rays, count, samples);
+                    else if (span == 8) scene.trace_packet<8>(rays, count, samples);
+                    else samples[0] = scene.trace_ray(rays[0], 0);
+
+                    for(int i=0; i<count; i++) pixels[i] += samples[i];
                 }
-                pixel /= float(render_settings::global_settings.ssp);
-                color mapped(
-                    (pixel.r),
-                    (pixel.g),
-                    (pixel.b)
-                );
-                color display(
-                    std::pow(mapped.r, 1.0f/2.2f),
-                    std::pow(mapped.g, 1.0f/2.2f),
-                    std::pow(mapped.b, 1.0f/2.2f)
-                );
-                img.at(x,y) = display.clamped();
+
+                for(int i=0; i<count; i++)
+                    img.at(x0 + i,y) = to_display(pixels[i] / float(render_settings::global_settings.ssp));
             }
 
             int done = ++rows_done;
@@ -143,23 +262,71 @@ int main()
     using clock = std::chrono::high_resolution_clock;
     auto start_time = clock::now();
 
-    int rows_per_thread = height / n_threads;
-    for(int t=0; t<n_threads; t++)
+    if (render_settings::global_settings.reservoir_resampling)
     {
-        int start = t * rows_per_thread;
-        int end = (t == n_threads-1) ? height : start + rows_per_thread;
-        threads.emplace_back(render_rows, start, end);
-    }
+        // whole-image passes, each reusing the light samples of the pass before
+        restir_renderer restir(width, height);
+        std::vector<color> sums(width * height, color(0,0,0));
+        const int passes = render_settings::global_settings.ssp;
+        for(int pass=0; pass<passes; pass++)
+        {
+            restir.render_pass(scene, cam, sums.data(), &pool);
+            std::cerr << "\rRendering: " << 100.0 * (pass + 1) / passes << "%" << std::flush;
+        }
 
+        for(int y=0; y<height; y++)
+            for(int x=0; x<width; x++)
+                img.at(x,y) = to_display(sums[y * width + x] / float(passes));
+    }
+    else if (render_settings::global_settings.adaptive_sampling)
+    {
+        // each pixel sampled until it converges, the budget left over going to the noisy ones
+        adaptive_sampler sampler(width, height);
+        sampler.render(scene, cam, &pool);
+        for(int y=0; y<height; y++)
+            for(int x=0; x<width; x++)
+                img.at(x,y) = to_display(sampler.mean(x,y));
 
-    while(rows_done < height)
+        bmp::texture_to_bmp(sampler.heatmap(), "sample_heatmap.bmp");
+        std::cout << "adaptive sampling: " << static_cast<double>(sampler.samples_taken()) / (width * height)
+                  << " spp on average, " << sampler.converged_pixels() << " of " << width * height
+                  << " pixels converged, sample counts in sample_heatmap.bmp\n";
+    }
+    else if (render_settings::global_settings.wavefront)
     {
-        int done = rows_done.load();
-        std::cerr << "\rRendering: " << 100.0 * done / height << "%" << std::flush;
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // stage by stage over batches of paths, with the throughput of each stage
+        wavefront_renderer wavefront(width, height, render_settings::global_settings.wavefront_paths);
+        std::vector<color> means(width * height);
+        wavefront.render(scene, cam, render_settings::global_settings.ssp, means.data(), &pool);
+        for(int y=0; y<height; y++)
+            for(int x=0; x<width; x++)
+                img.at(x,y) = to_display(means[y * width + x]);
+
+        const wavefront_stats& stages = wavefront.stats();
+        std::cout << std::fixed << std::setprecision(2);
+        for (const auto& [name, stage] : {std::pair{"generate", stages.generate}, std::pair{"intersect", stages.intersect},
+                                          std::pair{"shade", stages.shade}, std::pair{"shadow", stages.shadow}})
+            std::cout << "  " << std::setw(9) << std::left << name << std::right << std::setw(12) << stage.items
+                      << " items " << std::setw(10) << stage.ms << "ms " << std::setw(8) << stage.mitems_per_second() << " M/s\n";
+        std::cout << std::defaultfloat;
     }
+    else
+    {
+        // one task per row, the pool hands rows out to whichever thread is free
+        task_group rows(pool);
+        for(int y=0; y<height; y++)
+            rows.run([&render_rows, y] { render_rows(y, y+1); });
 
-    for(auto& th : threads) th.join();
+
+        while(rows_done < height)
+        {
+            int done = rows_done.load();
+            std::cerr << "\rRendering: " << 100.0 * done / height << "%" << std::flush;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        rows.wait();
+    }
 
     auto end_time = clock::now();
     std::chrono::duration<double> elapsed = end_time - start_time;